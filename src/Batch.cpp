@@ -0,0 +1,253 @@
+#include "Batch.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include "Profiler.hpp"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace Batch {
+
+// Loaded meshes waiting for a worker, and reordered meshes waiting for the writer, per worker
+constexpr size_t QUEUE_SIZE_PER_WORKER = 2;
+
+// Meshes of at least this many vertices are reordered with all the threads
+constexpr uint64_t LARGE_MESH_MIN_VERTICES = 1 << 18;
+
+// Blocking queue with a maximum size, closed by the producer when it ends
+template<typename T>
+class BoundedQueue {
+public:
+	explicit BoundedQueue(size_t capacity) :
+		m_capacity(capacity)
+	{}
+
+	// Waits while the queue is full
+	void push(T value) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_not_full.wait(lock, [&]() { return m_items.size() < m_capacity; });
+		m_items.push_back(std::move(value));
+		m_not_empty.notify_one();
+	}
+
+	// Waits while the queue is empty. Returns false once it is closed and empty
+	bool pop(T* value) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_not_empty.wait(lock, [&]() { return !m_items.empty() || m_closed; });
+		if (m_items.empty()) {
+			return false;
+		}
+		*value = std::move(m_items.front());
+		m_items.pop_front();
+		m_not_full.notify_one();
+		return true;
+	}
+
+	void close() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_closed = true;
+		m_not_empty.notify_all();
+	}
+
+private:
+	std::mutex m_mutex;
+	std::condition_variable m_not_empty;
+	std::condition_variable m_not_full;
+	std::deque<T> m_items;
+	const size_t m_capacity;
+	bool m_closed = false;
+};
+
+struct Job {
+	uint32_t input;
+	std::shared_ptr<TriangleMesh> mesh;
+};
+
+std::vector<std::string> list_inputs(const std::string& path)
+{
+	std::vector<std::string> inputs;
+	if (fs::is_directory(path)) {
+		for (const fs::directory_entry& entry : fs::directory_iterator(path)) {
+			if (entry.is_regular_file() && entry.path().extension() == ".ply") {
+				inputs.push_back(entry.path().string());
+			}
+		}
+		std::sort(inputs.begin(), inputs.end());
+		return inputs;
+	}
+
+	std::ifstream stream(path);
+	if (!stream.is_open()) {
+		throw std::runtime_error("Error: Can't open file " + path);
+	}
+	std::string line;
+	while (std::getline(stream, line)) {
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		if (!line.empty()) {
+			inputs.push_back(line);
+		}
+	}
+	return inputs;
+}
+
+// Threads of the OpenMP regions started by the calling thread
+static void set_num_threads(int num_threads)
+{
+#ifdef _OPENMP
+	omp_set_num_threads(num_threads);
+#endif
+}
+
+Report run(const std::vector<std::string>& inputs, const std::string& output_directory,
+	const Process& process, uint32_t num_workers)
+{
+	assert(num_workers > 0);
+	const auto ini_timer = std::chrono::steady_clock::now();
+
+	// The threads are split between the workers, but a large mesh takes all of them,
+	// so it does not run alone in one thread while the small ones are done
+	int max_threads = 1;
+#ifdef _OPENMP
+	max_threads = omp_get_max_threads();
+#endif
+	const int worker_threads = std::max(1, max_threads / (int)num_workers);
+
+	fs::create_directories(output_directory);
+	std::vector<std::string> outputs(inputs.size());
+	std::set<std::string> used_outputs;
+	for (uint32_t i = 0; i < (uint32_t)inputs.size(); ++i) {
+		outputs[i] = (fs::path(output_directory) / fs::path(inputs[i]).filename()).string();
+		if (!used_outputs.insert(outputs[i]).second) {
+			throw std::runtime_error("Error: Several inputs are written to " + outputs[i]);
+		}
+	}
+
+	// Largest first, missing files at the end to fail when they are read
+	std::vector<uint64_t> file_sizes(inputs.size());
+	for (uint32_t i = 0; i < (uint32_t)inputs.size(); ++i) {
+		std::error_code error;
+		const uint64_t size = fs::file_size(inputs[i], error);
+		file_sizes[i] = error ? 0 : size;
+	}
+	std::vector<uint32_t> order(inputs.size());
+	for (uint32_t i = 0; i < (uint32_t)order.size(); ++i) {
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+		return file_sizes[a] > file_sizes[b];
+	});
+
+	Report report;
+	std::mutex report_mutex;
+	auto fail = [&](uint32_t input, const std::exception& e) {
+		std::lock_guard<std::mutex> lock(report_mutex);
+		std::cerr << "Failed " << inputs[input] << ": " << e.what() << std::endl;
+		++report.num_failed;
+	};
+
+	BoundedQueue<Job> loaded(QUEUE_SIZE_PER_WORKER * num_workers);
+	BoundedQueue<Job> processed(QUEUE_SIZE_PER_WORKER * num_workers);
+
+	std::thread reader([&]() {
+		set_num_threads(worker_threads);
+		for (const uint32_t input : order) {
+			Job job;
+			job.input = input;
+			try {
+				Profiler::ScopedTimer timer("batch/read");
+				job.mesh = std::make_shared<TriangleMesh>(inputs[input].c_str());
+			}
+			catch (const std::exception& e) {
+				fail(input, e);
+				continue;
+			}
+			loaded.push(std::move(job));
+		}
+		loaded.close();
+	});
+
+	std::vector<std::thread> workers;
+	for (uint32_t w = 0; w < num_workers; ++w) {
+		workers.emplace_back([&]() {
+			Job job;
+			while (loaded.pop(&job)) {
+				const bool large = job.mesh->get_vertices().size() >= LARGE_MESH_MIN_VERTICES;
+				set_num_threads(large ? max_threads : worker_threads);
+				try {
+					Profiler::ScopedTimer timer("batch/process");
+					process(job.mesh);
+				}
+				catch (const std::exception& e) {
+					fail(job.input, e);
+					continue;
+				}
+				processed.push(std::move(job));
+			}
+		});
+	}
+
+	std::thread writer([&]() {
+		set_num_threads(worker_threads);
+		Job job;
+		while (processed.pop(&job)) {
+			try {
+				Profiler::ScopedTimer timer("batch/write");
+				job.mesh->write_mesh_ply(outputs[job.input].c_str());
+			}
+			catch (const std::exception& e) {
+				fail(job.input, e);
+				continue;
+			}
+			std::lock_guard<std::mutex> lock(report_mutex);
+			++report.num_meshes;
+			report.num_vertices += job.mesh->get_vertices().size();
+			report.num_faces += job.mesh->get_faces().size();
+		}
+	});
+
+	reader.join();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+	processed.close();
+	writer.join();
+
+	const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - ini_timer;
+	report.seconds = duration.count();
+
+	Profiler::add_counter("batch/meshes", report.num_meshes);
+	Profiler::add_counter("batch/failed", report.num_failed);
+	Profiler::add_counter("batch/vertices", report.num_vertices);
+	Profiler::add_counter("batch/faces", report.num_faces);
+	return report;
+}
+
+void print(const Report& report)
+{
+	const double seconds = std::max(report.seconds, 1.0e-9);
+	std::cout << "Batch:\n"
+		"\tMeshes: " << report.num_meshes << "\n"
+		"\tFailed: " << report.num_failed << "\n"
+		"\tVertices: " << report.num_vertices << "\n"
+		"\tFaces: " << report.num_faces << "\n"
+		"\tTime: " << report.seconds << " s\n"
+		"\tThroughput: " << report.num_meshes / seconds << " meshes/s, " <<
+		report.num_vertices / seconds << " vertices/s" << std::endl;
+}
+
+} // namespace
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "TriangleMesh.hpp"
+
+// Layout of many meshes in a pipeline of three stages: a reader thread loads the meshes,
+// a pool of workers reorders them and a writer thread writes them, connected by bounded queues.
+// Meshes are read from the largest file to the smallest, so a huge mesh starts first
+// and the small ones fill the other workers meanwhile, and they are written as they finish.
+// The OpenMP threads are split between the workers, and large meshes use all of them.
+namespace Batch {
+
+struct Report {
+	uint64_t num_meshes = 0;
+	uint64_t num_failed = 0;
+	uint64_t num_vertices = 0;
+	uint64_t num_faces = 0;
+	double seconds = 0.0;
+};
+
+// Reorders a mesh. Called from several workers at the same time
+typedef std::function<void(const std::shared_ptr<TriangleMesh>& mesh)> Process;
+
+// The .ply files of a directory, or the paths listed one per line in a file.
+// Throws if the path cannot be read.
+std::vector<std::string> list_inputs(const std::string& path);
+
+// Processes every input and writes it to the output directory with the same file name.
+// Meshes that fail are reported and counted, the others go on.
+// Throws if several inputs have the same file name.
+Report run(const std::vector<std::string>& inputs, const std::string& output_directory,
+	const Process& process, uint32_t num_workers);
+
+void print(const Report& report);
+
+} // namespace
@@ -0,0 +1,194 @@
+#include "Benchmark.hpp"
+
+#include <Spectra/MatOp/SparseSymMatProd.h>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include "Spectral.hpp"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace Benchmark {
+
+// Local CSR copy of the whole mesh graph, with unit weights
+static WeightedGraph mesh_weighted_graph(const MeshGraph& graph)
+{
+	WeightedGraph result;
+	result.offsets.assign(graph.get_offsets().begin(), graph.get_offsets().end());
+	result.neighbors = graph.get_neighbors();
+	return result;
+}
+
+void laplacian_products(const MeshGraph& graph, const uint32_t repetitions)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	typedef std::chrono::duration<double, std::milli> Millis;
+
+	const WeightedGraph wgraph = mesh_weighted_graph(graph);
+	const uint32_t n = wgraph.get_num_vertices();
+
+	Eigen::VectorXf x = Eigen::VectorXf::Random(n);
+	Eigen::VectorXf y_assembled(n), y_free(n);
+
+	int num_threads = 1;
+#ifdef _OPENMP
+	num_threads = omp_get_max_threads();
+#endif
+
+	// Assembled matrix
+	auto ini = Clock::now();
+	const Eigen::SparseMatrix<float> laplacian = Spectral::laplacian_matrix(wgraph);
+	Spectra::SparseSymMatProd<float> assembled_op(laplacian);
+	const Millis assembled_setup = Clock::now() - ini;
+
+	ini = Clock::now();
+	for (uint32_t r = 0; r < repetitions; ++r) {
+		assembled_op.perform_op(x.data(), y_assembled.data());
+	}
+	const Millis assembled_products = Clock::now() - ini;
+
+	// Matrix-free
+	ini = Clock::now();
+	const Spectral::LaplacianOp free_op(wgraph);
+	const Millis free_setup = Clock::now() - ini;
+
+	// On one thread, like SparseSymMatProd, and then on all of them
+	ini = Clock::now();
+#pragma omp parallel num_threads(1)
+#pragma omp single
+	for (uint32_t r = 0; r < repetitions; ++r) {
+		free_op.perform_op(x.data(), y_free.data());
+	}
+	const Millis free_products_serial = Clock::now() - ini;
+
+	ini = Clock::now();
+#pragma omp parallel
+#pragma omp single
+	for (uint32_t r = 0; r < repetitions; ++r) {
+		free_op.perform_op(x.data(), y_free.data());
+	}
+	const Millis free_products = Clock::now() - ini;
+
+	const size_t assembled_bytes = laplacian.nonZeros() * (sizeof(float) + sizeof(int)) +
+		(laplacian.outerSize() + 1) * sizeof(int);
+	const size_t free_bytes = n * sizeof(float);
+
+	std::cout << "Laplacian product benchmark (" << n << " rows, " <<
+		repetitions << " products):\n"
+		"\tSparseSymMatProd (1 thread): setup " << assembled_setup.count() << " ms, " <<
+		assembled_products.count() / repetitions << " ms/product, " <<
+		assembled_bytes << " bytes\n"
+		"\tLaplacianOp (1 thread):      setup " << free_setup.count() << " ms, " <<
+		free_products_serial.count() / repetitions << " ms/product, " <<
+		free_bytes << " bytes over the graph\n"
+		"\tLaplacianOp (" << num_threads << " threads): " <<
+		free_products.count() / repetitions << " ms/product\n"
+		"\tMax difference: " << (y_assembled - y_free).cwiseAbs().maxCoeff() << std::endl;
+}
+
+// Subgraph of the first size vertices reached by breadth first search from vertex 0
+static WeightedGraph breadth_first_piece(const MeshGraph& graph, const uint32_t size)
+{
+	const uint32_t unvisited = std::numeric_limits<uint32_t>::max();
+	std::vector<uint32_t> local(graph.get_num_vertices(), unvisited);
+	std::vector<uint32_t> order;
+	order.reserve(size);
+	order.push_back(0);
+	local[0] = 0;
+	for (size_t q = 0; q < order.size() && order.size() < size; ++q) {
+		for (const uint32_t* u = graph.neighbors_begin(order[q]); u != graph.neighbors_end(order[q]); ++u) {
+			if (local[*u] == unvisited && order.size() < size) {
+				local[*u] = (uint32_t)order.size();
+				order.push_back(*u);
+			}
+		}
+	}
+
+	WeightedGraph result;
+	result.offsets.push_back(0);
+	for (uint32_t v : order) {
+		for (const uint32_t* u = graph.neighbors_begin(v); u != graph.neighbors_end(v); ++u) {
+			if (local[*u] != unvisited) {
+				result.neighbors.push_back(local[*u]);
+			}
+		}
+		result.offsets.push_back((uint32_t)result.neighbors.size());
+	}
+	return result;
+}
+
+void eigen_solvers(const MeshGraph& graph, const uint32_t max_iterations, const float error,
+	const uint32_t repetitions)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	typedef std::chrono::duration<double, std::milli> Millis;
+
+	// The dense solver is cubic, skip it on the large pieces
+	const uint32_t dense_max_size = 2048;
+	const char* names[] = { "Dense", "Lanczos", "LOBPCG" };
+
+	std::cout << "Eigen solver benchmark (" << repetitions << " splits per solver):" << std::endl;
+
+	for (uint32_t size = 64; ; size *= 4) {
+		const WeightedGraph piece = breadth_first_piece(graph, std::min(size, graph.get_num_vertices()));
+		const uint32_t n = piece.get_num_vertices();
+		if (n < 4) {
+			break;
+		}
+		std::cout << "\t" << n << " vertices:" << std::endl;
+
+		for (uint32_t solver = 0; solver < 3; ++solver) {
+			if (solver == 0 && n > dense_max_size) {
+				continue;
+			}
+
+			Spectral::SolveStats stats;
+			Eigen::MatrixXf embedding;
+			bool solved = true;
+			const auto ini = Clock::now();
+			for (uint32_t r = 0; r < repetitions && solved; ++r) {
+				if (solver == 0) {
+					solved = Spectral::spectral_embedding_dense(piece, 1, &embedding, &stats);
+				}
+				else if (solver == 1) {
+					solved = Spectral::spectral_embedding_lanczos(piece, 1, max_iterations, error,
+						nullptr, &embedding, &stats);
+				}
+				else {
+					solved = Spectral::spectral_embedding_lobpcg(piece, 1, max_iterations, error,
+						nullptr, &embedding, &stats);
+				}
+			}
+			const Millis duration = Clock::now() - ini;
+
+			if (!solved) {
+				std::cout << "\t\t" << names[solver] << ": failed" << std::endl;
+				continue;
+			}
+
+			// Quality of the sign split
+			uint32_t size_0 = 0;
+			uint64_t cut = 0;
+			for (uint32_t v = 0; v < n; ++v) {
+				const bool side = embedding(v, 0) < 0.0f;
+				size_0 += side;
+				for (uint32_t i = piece.offsets[v]; i < piece.offsets[v + 1]; ++i) {
+					cut += side != (embedding(piece.neighbors[i], 0) < 0.0f);
+				}
+			}
+
+			std::cout << "\t\t" << names[solver] << ": " <<
+				duration.count() / repetitions << " ms/split, " <<
+				stats.num_operations / repetitions << " products, " <<
+				"halves " << size_0 << "/" << n - size_0 << ", " <<
+				cut / 2 << " cut edges" << std::endl;
+		}
+
+		if (n == graph.get_num_vertices()) {
+			break;
+		}
+	}
+}
+
+} // namespace
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include "MeshGraph.hpp"
+
+namespace Benchmark {
+
+// Compares the matrix-free Laplacian product with the assembled
+// Eigen::SparseMatrix and Spectra::SparseSymMatProd on the whole mesh graph,
+// both on one thread, and the matrix-free one on all the threads
+void laplacian_products(const MeshGraph& graph, const uint32_t repetitions);
+
+// Time to compute the Fiedler vector and split on its sign with each eigen
+// solver, on connected pieces of the mesh graph of increasing size, grown
+// by breadth first search from vertex 0
+void eigen_solvers(const MeshGraph& graph, const uint32_t max_iterations, const float error,
+	const uint32_t repetitions);
+
+} // namespace
@@ -0,0 +1,141 @@
+#include "CacheSimulator.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace CacheSimulator {
+
+// Each set keeps its tags from most to least recently used
+class LRUCache {
+public:
+	LRUCache(const MemoryLevel& level, uint32_t line_size) :
+		m_ways(std::max(1u, level.ways)),
+		m_num_sets(std::max<uint64_t>(1, level.size_bytes / line_size / m_ways)),
+		m_tags(m_num_sets * m_ways, EMPTY) {}
+
+	// Returns true on hit. The line is the most recently used after the access.
+	bool access(uint64_t line) {
+		uint64_t* set = m_tags.data() + (line % m_num_sets) * m_ways;
+		uint32_t i = 0;
+		while (i < m_ways && set[i] != line) {
+			i += 1;
+		}
+		const bool hit = i < m_ways;
+		// Shift the more recent ones, evicting the last one on a miss
+		for (uint32_t j = hit ? i : m_ways - 1; j > 0; --j) {
+			set[j] = set[j - 1];
+		}
+		set[0] = line;
+		return hit;
+	}
+
+private:
+	static constexpr uint64_t EMPTY = ~(uint64_t)0;
+
+	const uint32_t m_ways;
+	const uint64_t m_num_sets;
+	std::vector<uint64_t> m_tags;
+};
+
+// Post-transform cache of vertex ids
+class VertexCache {
+public:
+	VertexCache(uint32_t size, bool lru) :
+		m_entries(std::max(1u, size), -1), m_lru(lru), m_next(0) {}
+
+	bool access(int32_t v) {
+		const uint32_t size = (uint32_t)m_entries.size();
+		uint32_t i = 0;
+		while (i < size && m_entries[i] != v) {
+			i += 1;
+		}
+		if (m_lru) {
+			// Most recent first
+			for (uint32_t j = i < size ? i : size - 1; j > 0; --j) {
+				m_entries[j] = m_entries[j - 1];
+			}
+			m_entries[0] = v;
+			return i < size;
+		}
+		if (i < size) {
+			return true;
+		}
+		m_entries[m_next] = v;
+		m_next = (m_next + 1) % size;
+		return false;
+	}
+
+private:
+	std::vector<int32_t> m_entries;
+	const bool m_lru;
+	uint32_t m_next;
+};
+
+Result simulate(const TriangleMesh& mesh, const Config& config)
+{
+	const uint64_t stride = sizeof(Eigen::Vector3f) + mesh.get_vertex_attributes().stride;
+
+	Result result;
+	result.vertex_stride = stride;
+	result.num_triangles = mesh.get_faces().size();
+	result.num_vertices = mesh.get_vertices().size();
+	result.level_accesses.assign(config.memory_levels.size(), 0);
+	result.level_misses.assign(config.memory_levels.size(), 0);
+
+	VertexCache vertex_cache(config.vertex_cache_size, config.vertex_cache_lru);
+	std::vector<LRUCache> levels;
+	for (const MemoryLevel& level : config.memory_levels) {
+		levels.emplace_back(level, config.line_size);
+	}
+
+	for (const Eigen::Array3i& face : mesh.get_faces()) {
+		for (uint32_t j = 0; j < 3; ++j) {
+			if (vertex_cache.access(face[j])) {
+				continue;
+			}
+			result.vertex_cache_misses += 1;
+
+			// A vertex can straddle several lines
+			const uint64_t first_line = (uint64_t)face[j] * stride / config.line_size;
+			const uint64_t last_line = ((uint64_t)face[j] * stride + stride - 1) / config.line_size;
+			for (uint64_t line = first_line; line <= last_line; ++line) {
+				for (uint32_t l = 0; l < (uint32_t)levels.size(); ++l) {
+					result.level_accesses[l] += 1;
+					if (levels[l].access(line)) {
+						break;
+					}
+					result.level_misses[l] += 1;
+				}
+			}
+		}
+	}
+
+	if (result.num_triangles > 0) {
+		result.acmr = (double)result.vertex_cache_misses / result.num_triangles;
+	}
+	if (result.num_vertices > 0) {
+		result.atvr = (double)result.vertex_cache_misses / result.num_vertices;
+	}
+
+	return result;
+}
+
+void print(const Result& result, const Config& config, const char* title)
+{
+	std::cout << title << " cache simulation:\n"
+		"\tVertex cache: " << config.vertex_cache_size << " entries " <<
+		(config.vertex_cache_lru ? "LRU" : "FIFO") << "\n"
+		"\tVertex size: " << result.vertex_stride << " bytes\n"
+		"\tACMR: " << result.acmr << "\n"
+		"\tATVR: " << result.atvr << "\n";
+	for (uint32_t l = 0; l < (uint32_t)result.level_accesses.size(); ++l) {
+		const double miss_rate = result.level_accesses[l] == 0 ? 0.0 :
+			100.0 * result.level_misses[l] / result.level_accesses[l];
+		std::cout << "\tL" << l + 1 << " (" << config.memory_levels[l].size_bytes / 1024 << " KiB): " <<
+			result.level_accesses[l] << " line accesses, " <<
+			result.level_misses[l] << " misses (" << miss_rate << " %)\n";
+	}
+	std::cout << std::flush;
+}
+
+} // namespace
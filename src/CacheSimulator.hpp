@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "TriangleMesh.hpp"
+
+namespace CacheSimulator {
+
+// Set associative LRU cache of the memory hierarchy
+struct MemoryLevel {
+	uint64_t size_bytes;
+	uint32_t ways;
+};
+
+struct Config {
+	// Post-transform vertex cache, in vertices
+	uint32_t vertex_cache_size = 32;
+	// Replacement policy of the vertex cache, FIFO otherwise
+	bool vertex_cache_lru = false;
+	// Memory hierarchy, from the closest level, for the vertex fetches
+	std::vector<MemoryLevel> memory_levels = { { 32 * 1024, 8 }, { 1024 * 1024, 16 }, { 32 * 1024 * 1024, 16 } };
+	uint32_t line_size = 64;
+};
+
+struct Result {
+	// Bytes fetched per vertex
+	uint64_t vertex_stride = 0;
+	uint64_t num_triangles = 0;
+	uint64_t num_vertices = 0;
+	uint64_t vertex_cache_misses = 0;
+	// Average cache miss ratio: misses per triangle
+	double acmr = 0.0;
+	// Average transform to vertex ratio: misses per vertex
+	double atvr = 0.0;
+	// Line accesses and misses of each memory level
+	std::vector<uint64_t> level_accesses;
+	std::vector<uint64_t> level_misses;
+};
+
+// Renders the faces in order through the vertex cache, and fetches the missing
+// vertices through the memory levels. A vertex is its position followed by its
+// other attributes, as in the written mesh.
+Result simulate(const TriangleMesh& mesh, const Config& config = Config());
+
+void print(const Result& result, const Config& config, const char* title);
+
+} // namespace
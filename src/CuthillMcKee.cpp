@@ -0,0 +1,178 @@
+#include "CuthillMcKee.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <limits>
+#include <numeric>
+#include "Profiler.hpp"
+
+namespace CuthillMcKee {
+
+static constexpr uint32_t UNVISITED = std::numeric_limits<uint32_t>::max();
+
+// Levels with fewer vertices are expanded on the calling thread
+constexpr int64_t PARALLEL_LEVEL_MIN_SIZE = 1024;
+
+// Buffers of the traversal, reused between components
+struct TraversalState {
+	std::vector<uint32_t> level;
+	// Position in the order of the first frontier vertex that reaches each vertex
+	std::vector<std::atomic<uint32_t>> parent;
+	std::vector<uint32_t> num_children;
+
+	TraversalState(uint32_t n) : level(n, UNVISITED), parent(n) {
+		for (std::atomic<uint32_t>& p : parent) {
+			p.store(UNVISITED, std::memory_order_relaxed);
+		}
+	}
+};
+
+// Breadth first traversal from start. The children of a vertex are the neighbors
+// first reached from it, visited by increasing degree.
+// Appends the vertices to order and marks them with their level.
+template<typename Graph>
+static void traversal(const Graph& graph, uint32_t start, TraversalState* state, std::vector<uint32_t>* order)
+{
+	std::vector<uint32_t>& level = state->level;
+	std::vector<std::atomic<uint32_t>>& parent = state->parent;
+	std::vector<uint32_t>& num_children = state->num_children;
+
+	level[start] = 0;
+	order->push_back(start);
+
+	int64_t frontier_begin = (int64_t)order->size() - 1;
+	for (uint32_t l = 0; frontier_begin < (int64_t)order->size(); ++l) {
+		const int64_t frontier_end = (int64_t)order->size();
+		const int64_t frontier_size = frontier_end - frontier_begin;
+
+		// Each unvisited neighbor goes to its earliest frontier vertex
+#pragma omp parallel for if(frontier_size >= PARALLEL_LEVEL_MIN_SIZE)
+		for (int64_t p = frontier_begin; p < frontier_end; ++p) {
+			const uint32_t v = (*order)[p];
+			for (const uint32_t* u = graph.neighbors_begin(v); u != graph.neighbors_end(v); ++u) {
+				if (level[*u] != UNVISITED) {
+					continue;
+				}
+				uint32_t current = parent[*u].load(std::memory_order_relaxed);
+				while ((uint32_t)p < current &&
+					!parent[*u].compare_exchange_weak(current, (uint32_t)p, std::memory_order_relaxed)) {
+				}
+			}
+		}
+
+		num_children.assign(frontier_size + 1, 0);
+#pragma omp parallel for if(frontier_size >= PARALLEL_LEVEL_MIN_SIZE)
+		for (int64_t p = frontier_begin; p < frontier_end; ++p) {
+			const uint32_t v = (*order)[p];
+			uint32_t count = 0;
+			for (const uint32_t* u = graph.neighbors_begin(v); u != graph.neighbors_end(v); ++u) {
+				count += level[*u] == UNVISITED && parent[*u].load(std::memory_order_relaxed) == (uint32_t)p;
+			}
+			num_children[p - frontier_begin + 1] = count;
+		}
+		std::partial_sum(num_children.begin(), num_children.end(), num_children.begin());
+
+		// Write the next level in place, by parent and then by degree
+		order->resize(frontier_end + num_children.back());
+#pragma omp parallel for if(frontier_size >= PARALLEL_LEVEL_MIN_SIZE)
+		for (int64_t p = frontier_begin; p < frontier_end; ++p) {
+			const uint32_t v = (*order)[p];
+			uint32_t* const children = order->data() + frontier_end + num_children[p - frontier_begin];
+			uint32_t count = 0;
+			for (const uint32_t* u = graph.neighbors_begin(v); u != graph.neighbors_end(v); ++u) {
+				if (level[*u] == UNVISITED && parent[*u].load(std::memory_order_relaxed) == (uint32_t)p) {
+					children[count++] = *u;
+				}
+			}
+			std::stable_sort(children, children + count,
+				[&graph](uint32_t a, uint32_t b) { return graph.degree(a) < graph.degree(b); });
+		}
+
+		const int64_t next_end = (int64_t)order->size();
+#pragma omp parallel for if(next_end - frontier_end >= PARALLEL_LEVEL_MIN_SIZE)
+		for (int64_t i = frontier_end; i < next_end; ++i) {
+			level[(*order)[i]] = l + 1;
+			parent[(*order)[i]].store(UNVISITED, std::memory_order_relaxed);
+		}
+
+		frontier_begin = frontier_end;
+	}
+}
+
+template<typename Graph>
+std::vector<uint32_t> cuthill_mckee_order(const Graph& graph)
+{
+	const uint32_t n = graph.get_num_vertices();
+
+	// Seeds by increasing degree
+	std::vector<uint32_t> seeds(n);
+	std::iota(seeds.begin(), seeds.end(), 0);
+	std::stable_sort(seeds.begin(), seeds.end(),
+		[&graph](uint32_t a, uint32_t b) { return graph.degree(a) < graph.degree(b); });
+
+	TraversalState state(n);
+	std::vector<uint32_t> order, component;
+	order.reserve(n);
+
+	for (uint32_t seed : seeds) {
+		if (state.level[seed] != UNVISITED) {
+			continue;
+		}
+
+		// Pseudo-peripheral vertex: restart from the farthest vertex of
+		// minimum degree while the eccentricity grows
+		uint32_t start = seed;
+		uint32_t eccentricity = 0;
+		for (;;) {
+			component.clear();
+			traversal(graph, start, &state, &component);
+			const uint32_t last_level = state.level[component.back()];
+			size_t last_level_begin = component.size() - 1;
+			while (last_level_begin > 0 && state.level[component[last_level_begin - 1]] == last_level) {
+				--last_level_begin;
+			}
+			uint32_t candidate = component.back();
+			for (size_t i = last_level_begin; i < component.size(); ++i) {
+				if (graph.degree(component[i]) < graph.degree(candidate)) {
+					candidate = component[i];
+				}
+			}
+#pragma omp parallel for if(component.size() >= PARALLEL_LEVEL_MIN_SIZE)
+			for (int64_t i = 0; i < (int64_t)component.size(); ++i) {
+				state.level[component[i]] = UNVISITED;
+			}
+			if (last_level <= eccentricity) {
+				break;
+			}
+			eccentricity = last_level;
+			start = candidate;
+		}
+
+		traversal(graph, start, &state, &order);
+	}
+
+	assert(order.size() == n);
+
+	return order;
+}
+
+template std::vector<uint32_t> cuthill_mckee_order<MeshGraph>(const MeshGraph& graph);
+template std::vector<uint32_t> cuthill_mckee_order<WeightedGraph>(const WeightedGraph& graph);
+
+std::vector<uint32_t> reverse_cuthill_mckee_order(const MeshGraph& graph)
+{
+	Profiler::ScopedTimer timer("rcm/order");
+	const std::vector<uint32_t> order = cuthill_mckee_order(graph);
+	const uint32_t n = (uint32_t)order.size();
+
+	std::vector<uint32_t> old2new(n);
+#pragma omp parallel for
+	for (int64_t i = 0; i < (int64_t)n; ++i) {
+		old2new[order[i]] = n - 1 - (uint32_t)i;
+	}
+
+	return old2new;
+}
+
+} // namespace
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "MeshGraph.hpp"
+
+// Topological layout of the mesh vertices, independent of their positions
+namespace CuthillMcKee {
+
+// Cuthill-McKee order of each connected component, from a pseudo-peripheral vertex
+// found with repeated traversals. Components are taken by the smallest degree seed.
+// The traversal is a level synchronous BFS, parallel within each level, that gives
+// the same order as the sequential one.
+// Returns the old index of the vertex at each new position.
+// Implemented for MeshGraph and WeightedGraph, whose weights are ignored.
+template<typename Graph>
+std::vector<uint32_t> cuthill_mckee_order(const Graph& graph);
+
+// New position of each vertex in the reverse Cuthill-McKee order
+std::vector<uint32_t> reverse_cuthill_mckee_order(const MeshGraph& graph);
+
+} // namespace
@@ -0,0 +1,117 @@
+#include "Hash.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace Hash {
+
+constexpr size_t PARALLEL_BLOCK_SIZE = 1 << 20;
+
+constexpr uint64_t PRIME_1 = 11400714785074694791ULL;
+constexpr uint64_t PRIME_2 = 14029467366897019727ULL;
+constexpr uint64_t PRIME_3 = 1609587929392839161ULL;
+constexpr uint64_t PRIME_4 = 9650029242287828579ULL;
+constexpr uint64_t PRIME_5 = 2870177450012600261ULL;
+
+static inline uint64_t rotl(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read_64(const uint8_t* p)
+{
+	uint64_t v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t read_32(const uint8_t* p)
+{
+	uint32_t v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t round(uint64_t acc, uint64_t input)
+{
+	acc += input * PRIME_2;
+	acc = rotl(acc, 31);
+	return acc * PRIME_1;
+}
+
+static inline uint64_t merge_round(uint64_t acc, uint64_t val)
+{
+	acc ^= round(0, val);
+	return acc * PRIME_1 + PRIME_4;
+}
+
+uint64_t xxhash64(const void* data, size_t size, uint64_t seed)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	const uint8_t* const end = p + size;
+	uint64_t h;
+
+	if (size >= 32) {
+		uint64_t v1 = seed + PRIME_1 + PRIME_2;
+		uint64_t v2 = seed + PRIME_2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - PRIME_1;
+		const uint8_t* const limit = end - 32;
+		do {
+			v1 = round(v1, read_64(p));
+			v2 = round(v2, read_64(p + 8));
+			v3 = round(v3, read_64(p + 16));
+			v4 = round(v4, read_64(p + 24));
+			p += 32;
+		} while (p <= limit);
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		h = merge_round(h, v1);
+		h = merge_round(h, v2);
+		h = merge_round(h, v3);
+		h = merge_round(h, v4);
+	}
+	else {
+		h = seed + PRIME_5;
+	}
+	h += (uint64_t)size;
+
+	while (p + 8 <= end) {
+		h ^= round(0, read_64(p));
+		h = rotl(h, 27) * PRIME_1 + PRIME_4;
+		p += 8;
+	}
+	if (p + 4 <= end) {
+		h ^= (uint64_t)read_32(p) * PRIME_1;
+		h = rotl(h, 23) * PRIME_2 + PRIME_3;
+		p += 4;
+	}
+	while (p < end) {
+		h ^= (*p) * PRIME_5;
+		h = rotl(h, 11) * PRIME_1;
+		++p;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME_2;
+	h ^= h >> 29;
+	h *= PRIME_3;
+	h ^= h >> 32;
+	return h;
+}
+
+uint64_t parallel_hash(const void* data, size_t size, uint64_t seed)
+{
+	const uint8_t* const bytes = static_cast<const uint8_t*>(data);
+	const int64_t num_blocks = (int64_t)((size + PARALLEL_BLOCK_SIZE - 1) / PARALLEL_BLOCK_SIZE);
+	std::vector<uint64_t> block_hashes(num_blocks);
+#pragma omp parallel for schedule(static)
+	for (int64_t b = 0; b < num_blocks; ++b) {
+		const size_t begin = b * PARALLEL_BLOCK_SIZE;
+		const size_t block_size = std::min(PARALLEL_BLOCK_SIZE, size - begin);
+		block_hashes[b] = xxhash64(bytes + begin, block_size, seed);
+	}
+	return xxhash64(block_hashes.data(), block_hashes.size() * sizeof(uint64_t), seed + (uint64_t)size);
+}
+
+} // namespace
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Non cryptographic hashes of memory buffers
+namespace Hash {
+
+// XXH64 of the bytes
+uint64_t xxhash64(const void* data, size_t size, uint64_t seed = 0);
+
+// Hash of large buffers computed in parallel: XXH64 of the XXH64 of 1 MB blocks.
+// The blocks do not depend on the number of threads.
+uint64_t parallel_hash(const void* data, size_t size, uint64_t seed = 0);
+
+} // namespace
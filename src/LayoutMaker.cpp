@@ -1,354 +1,736 @@
 #include "LayoutMaker.hpp"
 
-#include <Eigen/SparseCore>
-#include <Spectra/SymEigsSolver.h>
-#include <Spectra/MatOp/SparseSymMatProd.h>
-#include <unordered_set>
-#include <unordered_map>
+#include <Eigen/Eigenvalues>
+#include <algorithm>
+#include <limits>
 #include <iostream>
 #include <numeric>
-#include <stack>
+#include <array>
+#include <atomic>
 #include "UnionFind.hpp"
+#include "Spectral.hpp"
+#include "Profiler.hpp"
 
 namespace LayoutMaker {
 
+// Vertices of each final cluster, in depth first order of the bisection tree
+typedef std::vector<std::vector<uint32_t>> ClusterList;
+
+// Partitions smaller than this are bisected inside the task of their parent
+constexpr uint32_t MIN_TASK_PARTITION_SIZE = 2048;
+
+constexpr uint32_t NOT_IN_PARTITION = std::numeric_limits<uint32_t>::max();
+
+// Connected components of octree leaves of at least this size are found in parallel
+constexpr int64_t PARALLEL_COMPONENTS_MIN_SIZE = 50000;
+constexpr int64_t PARALLEL_COMPONENTS_GRAIN = 8192;
+
+// Multilevel solver: size of the coarsest graph and smoothing steps per level
+constexpr uint32_t MULTILEVEL_COARSEST_SIZE = 1024;
+constexpr uint32_t MULTILEVEL_SMOOTHING_STEPS = 10;
+
+// Adaptive eigen solver budget: loosest tolerance and fewest iterations
+constexpr float ADAPTIVE_MAX_ERROR = 1.0e-3f;
+constexpr uint32_t ADAPTIVE_MIN_ITERATIONS = 100;
+
+// Smoothing steps of the initial guess when the eigen solver fails
+constexpr uint32_t FALLBACK_SMOOTHING_STEPS = 50;
+
 struct LayoutContext {
 
-	uint32_t next_id;
 	const std::shared_ptr<TriangleMesh> p_mesh;
+	const MeshGraph& graph;
 	const uint32_t max_depth;
 	const uint32_t max_cluster_size;
 	const uint32_t max_spectral_size;
 	std::vector<uint32_t> final_cluster;
 	const uint32_t max_iterations_eigen;
 	const float error_eigen;
+	const bool warm_start;
+	// Use the multilevel solver for partitions of at least max_spectral_size
+	// vertices, instead of splitting them with an octree
+	const bool multilevel;
+	const SplitStrategy split;
+	// Parts of each spectral split. More than 2 uses that many eigenvectors.
+	const uint32_t num_parts;
+	// Scale the eigen solver tolerance and iterations with the partition size
+	const bool adaptive_eigen;
+	const EigenSolver eigen_solver;
+
+	// Last Fiedler vector computed for each vertex, used as warm start of the
+	// children. Partitions are disjoint, so concurrent tasks never share entries.
+	mutable std::vector<float> fiedler_guess;
+
+	// Index of each vertex inside the partition being processed. Stale entries
+	// are detected by checking them against the partition, so it is never
+	// cleared. Atomic because tasks read the entries of neighbors in other partitions.
+	mutable std::vector<std::atomic<uint32_t>> local_index;
+
+	// Solver statistics
+	mutable std::atomic<uint64_t> num_solves;
+	mutable std::atomic<uint64_t> num_iterations_eigen;
+	mutable std::atomic<uint64_t> num_operations_eigen;
+	mutable std::atomic<uint64_t> num_fallbacks;
 
 	LayoutContext(
 		const std::shared_ptr<TriangleMesh> p_mesh,
+		const MeshGraph& graph,
 		uint32_t max_depth,
 		uint32_t max_cluster_size,
 		uint32_t max_spectral_size,
 		uint32_t max_iterations_eigen,
-		float error_eigen) :
-		next_id(0), p_mesh(p_mesh), max_depth(max_depth),
+		float error_eigen,
+		bool warm_start,
+		bool multilevel,
+		SplitStrategy split,
+		uint32_t num_parts,
+		bool adaptive_eigen,
+		EigenSolver eigen_solver) :
+		p_mesh(p_mesh), graph(graph), max_depth(max_depth),
 		max_cluster_size(max_cluster_size),
 		max_spectral_size(max_spectral_size),
 		max_iterations_eigen(max_iterations_eigen),
-		error_eigen(error_eigen)
+		error_eigen(error_eigen),
+		warm_start(warm_start),
+		multilevel(multilevel),
+		split(split),
+		num_parts(num_parts),
+		adaptive_eigen(adaptive_eigen),
+		eigen_solver(eigen_solver),
+		num_solves(0), num_iterations_eigen(0), num_operations_eigen(0), num_fallbacks(0)
 	{
 		final_cluster.resize(p_mesh->get_vertices().size(), 0);
+		local_index = std::vector<std::atomic<uint32_t>>(p_mesh->get_vertices().size());
+		for (std::atomic<uint32_t>& i : local_index) {
+			i.store(NOT_IN_PARTITION, std::memory_order_relaxed);
+		}
+		if (warm_start) {
+			fiedler_guess.resize(p_mesh->get_vertices().size(), 0.0f);
+		}
+	}
+
+	void set_local_index(uint32_t v, uint32_t i) const {
+		local_index[v].store(i, std::memory_order_relaxed);
+	}
+
+	// Index of v, which belongs to the partition of the caller. Unlike
+	// get_local_index it stays valid while the partition is reordered.
+	uint32_t get_own_local_index(uint32_t v) const {
+		return local_index[v].load(std::memory_order_relaxed);
+	}
+
+	// Index of v in the partition, or NOT_IN_PARTITION
+	uint32_t get_local_index(uint32_t v, const uint32_t* partition, uint32_t partition_size) const {
+		const uint32_t i = local_index[v].load(std::memory_order_relaxed);
+		return i < partition_size && partition[i] == v ? i : NOT_IN_PARTITION;
+	}
+
+	// Give ids to the clusters in order. Vertices not in any cluster keep the id 0.
+	void assign_cluster_ids(const std::vector<ClusterList>& clusters) {
+		uint32_t next_id = 0;
+		for (const ClusterList& list : clusters) {
+			for (const std::vector<uint32_t>& cluster : list) {
+				for (uint32_t idx : cluster) {
+					final_cluster[idx] = next_id;
+				}
+				next_id += 1;
+			}
+		}
 	}
 };
 
-void vertex_laplacian_layout(
-	LayoutContext& context,
+// Initial vector for the Lanczos iterations. At the root of a bisection it is
+// the coordinate along the principal axis of the vertices, below it is the
+// Fiedler vector of the parent restricted to the partition.
+// Returns false if there is no usable guess.
+bool fiedler_initial_guess(
+	const LayoutContext& context,
 	const uint32_t depth,
-	const std::unordered_multimap<uint32_t, uint32_t>& vert2face,
-	const std::unordered_set<uint32_t>& vertices_indices) {
+	const uint32_t* vertices_begin,
+	const uint32_t* vertices_end,
+	Eigen::VectorXf* guess) {
+
+	const uint32_t n = (uint32_t)(vertices_end - vertices_begin);
+	guess->resize(n);
+
+	if (depth == 0) {
+		const std::vector<Eigen::Vector3f>& vertices = context.p_mesh->get_vertices();
+		Eigen::Vector3f mean = Eigen::Vector3f::Zero();
+		for (uint32_t i = 0; i < n; ++i) {
+			mean += vertices[vertices_begin[i]];
+		}
+		mean /= (float)n;
+		Eigen::Matrix3f cov = Eigen::Matrix3f::Zero();
+		for (uint32_t i = 0; i < n; ++i) {
+			const Eigen::Vector3f d = vertices[vertices_begin[i]] - mean;
+			cov += d * d.transpose();
+		}
+		Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> es(cov);
+		const Eigen::Vector3f axis = es.eigenvectors().col(2);
+		for (uint32_t i = 0; i < n; ++i) {
+			(*guess)[i] = axis.dot(vertices[vertices_begin[i]] - mean);
+		}
+	}
+	else {
+		for (uint32_t i = 0; i < n; ++i) {
+			(*guess)[i] = context.fiedler_guess[vertices_begin[i]];
+		}
+	}
 
-	
-	// Termination if conditions fulfilled
-	if (vertices_indices.empty()) {
+	// Make it orthogonal to the constant vector
+	guess->array() -= guess->mean();
+	const float norm = guess->norm();
+	if (!(norm > 1.0e-12f)) {
+		return false;
+	}
+	*guess /= norm;
+
+	// The constant vector is the other eigenvector requested,
+	// give it the same weight so both converge together
+	guess->array() += 1.0f / std::sqrt((float)n);
+
+	return true;
+}
+
+// Tolerance and iterations of the eigen solver for a partition of n vertices.
+// If adaptive, large partitions get a looser tolerance and fewer iterations,
+// as only the sign pattern of the Fiedler vector matters, and both reach the
+// given values at max_cluster_size vertices.
+void eigen_budget(
+	const LayoutContext& context,
+	const uint32_t n,
+	uint32_t* max_iterations,
+	float* error) {
+
+	*max_iterations = context.max_iterations_eigen;
+	*error = context.error_eigen;
+	if (!context.adaptive_eigen) {
 		return;
 	}
-	if (depth >= context.max_depth) {
-		std::cout << "Broke on depth " << depth << " with vertices " << vertices_indices.size() << std::endl;
-		assert(false);
+
+	const float scale = std::max(1.0f, (float)n / (float)context.max_cluster_size);
+	*error = std::max(context.error_eigen, std::min(ADAPTIVE_MAX_ERROR, context.error_eigen * scale));
+	*max_iterations = std::min(context.max_iterations_eigen,
+		std::max(ADAPTIVE_MIN_ITERATIONS, (uint32_t)((float)context.max_iterations_eigen / scale)));
+}
+
+// Solve with the eigen solver chosen by -eigen_solver: dense, LOBPCG,
+// or Lanczos otherwise.
+bool spectral_embedding(
+	const LayoutContext& context,
+	const WeightedGraph& graph,
+	const uint32_t num_vectors,
+	const uint32_t max_iterations,
+	const float error,
+	const Eigen::VectorXf* initial_guess,
+	Eigen::MatrixXf* embedding,
+	Spectral::SolveStats* stats) {
+
+	switch (context.eigen_solver) {
+	case EigenSolver::Dense:
+		return Spectral::spectral_embedding_dense(graph, num_vectors, embedding, stats);
+	case EigenSolver::Lobpcg:
+		return Spectral::spectral_embedding_lobpcg(graph, num_vectors,
+			max_iterations, error, initial_guess, embedding, stats);
+	default:
+		return Spectral::spectral_embedding_lanczos(graph, num_vectors,
+			max_iterations, error, initial_guess, embedding, stats);
 	}
-	if (depth >= context.max_depth || vertices_indices.size() <= context.max_cluster_size) {
-		const uint32_t id = context.next_id++;
-		for (uint32_t idx : vertices_indices) {
-			context.final_cluster[idx] = id;
+}
+
+// Reorder the partition so that the first half goes before the returned pointer.
+// The local indices must be those of the partition.
+uint32_t* split_partition(
+	const LayoutContext& context,
+	const WeightedGraph& subgraph,
+	const Eigen::VectorXf& fiedler,
+	uint32_t* vertices_begin,
+	uint32_t* vertices_end) {
+
+	const uint32_t n = (uint32_t)(vertices_end - vertices_begin);
+	auto by_value = [&](uint32_t a, uint32_t b) {
+		return fiedler[context.get_own_local_index(a)] < fiedler[context.get_own_local_index(b)];
+	};
+
+	switch (context.split) {
+	case SplitStrategy::Sign:
+		return std::partition(vertices_begin, vertices_end,
+			[&](uint32_t v) { return fiedler[context.get_own_local_index(v)] < 0.0f; });
+
+	case SplitStrategy::Median:
+	case SplitStrategy::Padded: {
+		uint32_t size_0 = n / 2;
+		if (context.split == SplitStrategy::Padded) {
+			const uint32_t num_clusters = (n + context.max_cluster_size - 1) / context.max_cluster_size;
+			size_0 = (num_clusters / 2) * context.max_cluster_size;
 		}
-		return;
+		std::nth_element(vertices_begin, vertices_begin + size_0, vertices_end, by_value);
+		return vertices_begin + size_0;
 	}
 
-	std::unordered_map<uint32_t, uint32_t> old2new_vert;
-	std::vector<uint32_t> new2old_vert(vertices_indices.size());
-	old2new_vert.reserve(vertices_indices.size());
-	{
-		std::unordered_set<uint32_t>::const_iterator it = vertices_indices.begin();
-		for (uint32_t i = 0; i < (uint32_t)vertices_indices.size(); ++i, ++it) {
-			old2new_vert.insert({ *it, i });
-			new2old_vert[i] = *it;
+	case SplitStrategy::RatioCut: {
+		std::sort(vertices_begin, vertices_end, by_value);
+
+		std::vector<uint32_t> rank(n);
+		float total_volume = 0.0f;
+		for (uint32_t i = 0; i < n; ++i) {
+			const uint32_t v = context.get_own_local_index(vertices_begin[i]);
+			rank[v] = i;
+			total_volume += subgraph.weighted_degree(v);
 		}
-	}
 
-	// Compute second smallest eigenvector
-	std::vector<uint32_t> vert_degree(vertices_indices.size(), 0);
-	std::vector< Eigen::Triplet<float>> triplet_list;
-	triplet_list.reserve(3 * vertices_indices.size());
-	// Fill connectivity
-	std::unordered_set<uint32_t>::const_iterator it = vertices_indices.begin();
-	for (uint32_t v_new = 0; v_new < (uint32_t)vertices_indices.size(); ++v_new, ++it) {
-		uint32_t v_old = *it;
-		auto range = vert2face.equal_range(v_old);
-		std::for_each(range.first, range.second,
-			[&](const std::pair<const uint32_t, uint32_t>& f_id) {
-				const Eigen::Array3i& face = context.p_mesh->get_faces().at(f_id.second);
-				for (uint32_t j = 0; j < 3; ++j) {
-					uint32_t v2_old = face[j];
-					if (v2_old != v_old) {
-						if (vertices_indices.count(v2_old) != 0) {
-							vert_degree[v_new] += 1;
-							uint32_t v2_new = old2new_vert.at(v2_old);
-							triplet_list.push_back(Eigen::Triplet<float>(v_new, v2_new, -1.f));
-						}
-					}
-				}
-			});
+		// Move the vertices to the first half one by one, updating the cut
+		float cut = 0.0f;
+		float volume_0 = 0.0f;
+		float best_conductance = std::numeric_limits<float>::infinity();
+		uint32_t size_0 = n / 2;
+		for (uint32_t i = 0; i + 1 < n; ++i) {
+			const uint32_t v = context.get_own_local_index(vertices_begin[i]);
+			for (uint32_t k = subgraph.offsets[v]; k < subgraph.offsets[v + 1]; ++k) {
+				cut += rank[subgraph.neighbors[k]] < i ? -subgraph.weight(k) : subgraph.weight(k);
+			}
+			volume_0 += subgraph.weighted_degree(v);
+
+			const float conductance = cut / std::max(std::min(volume_0, total_volume - volume_0), 1.0f);
+			if (conductance < best_conductance) {
+				best_conductance = conductance;
+				size_0 = i + 1;
+			}
+		}
+		return vertices_begin + size_0;
+	}
 	}
 
-	// fill degree triplets
-	for (uint32_t i = 0; i < (uint32_t)vertices_indices.size(); ++i) {
-		triplet_list.push_back(Eigen::Triplet<float>(i, i, (float)vert_degree[i]));
+	assert(false);
+	return vertices_begin;
+}
+
+// Recursive coordinate bisection of the partition in its spectral embedding,
+// into num_parts ranges of similar size. Each time the range is split at the
+// median of the coordinate with the largest extent.
+// Appends the end of each part to part_ends.
+void embedding_bisection(
+	const LayoutContext& context,
+	const Eigen::MatrixXf& embedding,
+	uint32_t* vertices_begin,
+	uint32_t* vertices_end,
+	const uint32_t num_parts,
+	std::vector<uint32_t*>* part_ends) {
+
+	if (num_parts == 1) {
+		part_ends->push_back(vertices_end);
+		return;
 	}
 
+	Eigen::VectorXf min_coord = Eigen::VectorXf::Constant(embedding.cols(), std::numeric_limits<float>::infinity());
+	Eigen::VectorXf max_coord = Eigen::VectorXf::Constant(embedding.cols(), -std::numeric_limits<float>::infinity());
+	for (const uint32_t* v = vertices_begin; v != vertices_end; ++v) {
+		const uint32_t i = context.get_own_local_index(*v);
+		min_coord = min_coord.cwiseMin(embedding.row(i).transpose());
+		max_coord = max_coord.cwiseMax(embedding.row(i).transpose());
+	}
+	Eigen::Index axis;
+	(max_coord - min_coord).maxCoeff(&axis);
+
+	const uint32_t parts_0 = num_parts / 2;
+	uint32_t* const middle = vertices_begin + (uint64_t)(vertices_end - vertices_begin) * parts_0 / num_parts;
+	std::nth_element(vertices_begin, middle, vertices_end,
+		[&](uint32_t a, uint32_t b) {
+			return embedding(context.get_own_local_index(a), axis) < embedding(context.get_own_local_index(b), axis);
+		});
+
+	embedding_bisection(context, embedding, vertices_begin, middle, parts_0, part_ends);
+	embedding_bisection(context, embedding, middle, vertices_end, num_parts - parts_0, part_ends);
+}
 
-	// Square sparse matrix
-	Eigen::SparseMatrix<float> laplacian(vertices_indices.size(), vertices_indices.size());
-	laplacian.setFromTriplets(triplet_list.begin(), triplet_list.end());
-	laplacian.makeCompressed();
+void components_layout(
+	const LayoutContext& context,
+	const uint32_t depth,
+	uint32_t* vertices_begin,
+	uint32_t* vertices_end,
+	ClusterList* out);
 
-	Spectra::SparseSymMatProd<float> op(laplacian);
-	// Get Fiedler vector
-	// Compute second smallest eigenvector
-	Spectra::SymEigsSolver<Spectra::SparseSymMatProd<float>> eigs(op, 2, 4);
-	eigs.init();
+// Recursive spectral bisection of the vertices [vertices_begin, vertices_end).
+// The range is partitioned in place, and the resulting clusters are appended to out.
+// The two halves are processed as OpenMP tasks when large enough.
+void vertex_laplacian_layout(
+	const LayoutContext& context,
+	const uint32_t depth,
+	uint32_t* vertices_begin,
+	uint32_t* vertices_end,
+	ClusterList* out) {
 
-	Eigen::Index num_values = eigs.compute(Spectra::SortRule::SmallestAlge,
-		context.max_iterations_eigen, context.error_eigen,
-		Spectra::SortRule::LargestAlge);
+	const uint32_t n = (uint32_t)(vertices_end - vertices_begin);
 
-	if (num_values != 2) {
-		std::cerr << "Error: num eigenvalues computed is " << num_values << std::endl;
+	// Termination if conditions fulfilled
+	if (n == 0) {
 		return;
 	}
-	// Get results
-	if (eigs.info() != Spectra::CompInfo::Successful) {
-		std::cout << "Error: No eigenvalues. Computation not successful!" << std::endl;
+	if (depth >= context.max_depth) {
+		std::cout << "Broke on depth " << depth << " with vertices " << n << std::endl;
+		assert(false);
+	}
+	if (depth >= context.max_depth || n <= context.max_cluster_size) {
+		out->emplace_back(vertices_begin, vertices_end);
 		return;
 	}
 
-	float eigenvalue = eigs.eigenvalues()[0];
-	if (eigenvalue <= 0) {
-		std::cerr << "Error: Fiedler eigenvalue is less than 0. Not a connected graph!!" << std::endl;
-		std::cerr << "Computed eigenvalues " << eigenvalue << std::endl;
+	for (uint32_t i = 0; i < n; ++i) {
+		context.set_local_index(vertices_begin[i], i);
+	}
 
-		return;
+	// Subgraph of the partition
+	Profiler::ScopedTimer subgraph_timer("layout/subgraph");
+	WeightedGraph subgraph;
+	subgraph.offsets.reserve(n + 1);
+	subgraph.neighbors.reserve(6 * n);
+	subgraph.offsets.push_back(0);
+	for (uint32_t i = 0; i < n; ++i) {
+		const uint32_t* n_end = context.graph.neighbors_end(vertices_begin[i]);
+		for (const uint32_t* u = context.graph.neighbors_begin(vertices_begin[i]); u != n_end; ++u) {
+			const uint32_t j = context.get_local_index(*u, vertices_begin, n);
+			if (j != NOT_IN_PARTITION) {
+				subgraph.neighbors.push_back(j);
+			}
+		}
+		subgraph.offsets.push_back((uint32_t)subgraph.neighbors.size());
+	}
+	subgraph_timer.stop();
+
+	// Split in several parts at once if there is room for them.
+	// The multilevel solver only computes the Fiedler vector.
+	const bool use_multilevel = context.multilevel && n >= context.max_spectral_size;
+	uint32_t num_parts = std::min(context.num_parts, (n + context.max_cluster_size - 1) / context.max_cluster_size);
+	if (use_multilevel || n <= 2 * num_parts) {
+		num_parts = 2;
 	}
 
-	const Eigen::VectorXf eigenvectors = eigs.eigenvectors().col(0);
+	uint32_t max_iterations;
+	float error;
+	eigen_budget(context, n, &max_iterations, &error);
+
+	// Compute second smallest eigenvector, and the next ones for a multiway split
+	Profiler::ScopedTimer solve_timer("layout/eigen_solve");
+	Eigen::VectorXf eigenvectors;
+	Eigen::MatrixXf embedding;
+	Spectral::SolveStats stats;
+	bool solved;
+	if (use_multilevel) {
+		solved = Spectral::fiedler_vector_multilevel(subgraph,
+			max_iterations, error,
+			MULTILEVEL_COARSEST_SIZE, MULTILEVEL_SMOOTHING_STEPS,
+			&eigenvectors, &stats);
+	}
+	else {
+		Eigen::VectorXf guess;
+		const bool use_guess = context.warm_start &&
+			fiedler_initial_guess(context, depth, vertices_begin, vertices_end, &guess);
+		solved = spectral_embedding(context, subgraph, num_parts - 1,
+			max_iterations, error,
+			use_guess ? &guess : nullptr,
+			&embedding, &stats);
+		if (solved) {
+			eigenvectors = embedding.col(0);
+		}
+	}
 
+	// Spectra does not give the Ritz vectors that did not converge. Instead of
+	// leaving the partition without clusters, refine the initial guess.
+	if (!solved) {
+		const uint32_t guess_depth = context.warm_start ? depth : 0;
+		if (!fiedler_initial_guess(context, guess_depth, vertices_begin, vertices_end, &eigenvectors)) {
+			eigenvectors = Eigen::VectorXf::LinSpaced(n, -1.0f, 1.0f);
+		}
+		Spectral::smooth_fiedler_vector(subgraph, FALLBACK_SMOOTHING_STEPS, &eigenvectors, &stats);
+		num_parts = 2;
+		context.num_fallbacks += 1;
+	}
 
-	// Output or continue
-	{
-		uint32_t size_cluster_0 = 0;
-		for (uint32_t i = 0; i < (uint32_t)eigenvectors.size(); ++i) {
-			if (eigenvectors[i] < 0.0f) {
-				size_cluster_0 += 1;
-			}
+	solve_timer.stop();
+
+	context.num_solves += 1;
+	context.num_iterations_eigen += stats.num_iterations;
+	context.num_operations_eigen += stats.num_operations;
+
+	if (context.warm_start) {
+		for (uint32_t i = 0; i < n; ++i) {
+			context.fiedler_guess[vertices_begin[i]] = eigenvectors[i];
 		}
-		std::unordered_set<uint32_t> indices_0, indices_1;
-		indices_0.reserve(size_cluster_0);
-		indices_1.reserve((uint32_t)eigenvectors.size() - size_cluster_0);
+	}
+
 
-		for (uint32_t i = 0; i < (uint32_t)eigenvectors.size(); ++i) {
-			if (eigenvectors[i] < 0.0f) {
-				indices_0.insert(new2old_vert[i]);
+	// Output or continue
+	if (num_parts > 2) {
+		std::vector<uint32_t*> part_ends;
+		Profiler::ScopedTimer split_timer("layout/split");
+		embedding_bisection(context, embedding, vertices_begin, vertices_end, num_parts, &part_ends);
+		split_timer.stop();
+
+		// Each part writes its own list, to keep the depth first order.
+		// Unlike the halves of a bisection, the parts are often not connected.
+		std::vector<ClusterList> part_out(num_parts);
+		uint32_t* part_begin = vertices_begin;
+		for (uint32_t p = 0; p < num_parts; ++p) {
+			uint32_t* const part_end = part_ends[p];
+			if (part_end - part_begin <= context.max_cluster_size) {
+				part_out[p].emplace_back(part_begin, part_end);
 			}
 			else {
-				indices_1.insert(new2old_vert[i]);
+#pragma omp task default(shared) firstprivate(part_begin, part_end, p) if(part_end - part_begin >= MIN_TASK_PARTITION_SIZE)
+				components_layout(context, depth + 1, part_begin, part_end, &part_out[p]);
 			}
+			part_begin = part_end;
 		}
 
-		vertex_laplacian_layout(context, depth + 1, vert2face,
-				indices_0);
-		
-		vertex_laplacian_layout(context, depth + 1, vert2face,
-				indices_1);
-		
+#pragma omp taskwait
+
+		for (ClusterList& list : part_out) {
+			out->insert(out->end(),
+				std::make_move_iterator(list.begin()), std::make_move_iterator(list.end()));
+		}
 	}
+	else {
+		Profiler::ScopedTimer split_timer("layout/split");
+		uint32_t* const middle = split_partition(context, subgraph, eigenvectors, vertices_begin, vertices_end);
+		split_timer.stop();
 
-}
+		// The second half writes to its own list, to keep the depth first order
+		ClusterList out_1;
 
+#pragma omp task default(shared) if(middle - vertices_begin >= MIN_TASK_PARTITION_SIZE)
+		vertex_laplacian_layout(context, depth + 1, vertices_begin, middle, out);
 
+#pragma omp task default(shared) if(vertices_end - middle >= MIN_TASK_PARTITION_SIZE)
+		vertex_laplacian_layout(context, depth + 1, middle, vertices_end, &out_1);
 
-void vertex_clustering_layout(
-	LayoutContext& context,
-	const std::unordered_multimap<uint32_t, uint32_t>& vert2face) {
-	if (context.p_mesh->get_vertices().empty()) {
-		return;
+#pragma omp taskwait
+
+		out->insert(out->end(),
+			std::make_move_iterator(out_1.begin()), std::make_move_iterator(out_1.end()));
 	}
 
-	const std::vector<Eigen::Vector3f>& vertices_mesh = context.p_mesh->get_vertices();
+}
 
-	struct OctNodeTask {
-		std::vector<uint32_t> vertices;
-		uint32_t depth;
-		Eigen::Vector3f mid_coord;
-	};
 
-	Eigen::Vector3f minBBox = Eigen::Vector3f::Constant( std::numeric_limits<float>::infinity());
-	Eigen::Vector3f maxBBox = Eigen::Vector3f::Constant(-std::numeric_limits<float>::infinity());
 
-	for (const Eigen::Vector3f& v : context.p_mesh->get_vertices()) {
-		minBBox = minBBox.cwiseMin(v);
-		maxBBox = maxBBox.cwiseMax(v);
-	}
+// Spectral clustering of each connected component of a partition, such as an
+// octree leaf. The partition is reordered by component.
+void components_layout(
+	const LayoutContext& context,
+	const uint32_t depth,
+	uint32_t* vertices_begin,
+	uint32_t* vertices_end,
+	ClusterList* out) {
 
-	const float octree_size = (maxBBox - minBBox).maxCoeff();
+	const int64_t n = vertices_end - vertices_begin;
 
-	std::stack<OctNodeTask> tasks;
-	std::array<std::vector<uint32_t>, 8> child_verts;
+	Profiler::ScopedTimer components_timer("layout/components");
+#pragma omp taskloop default(shared) grainsize(PARALLEL_COMPONENTS_GRAIN) if(n >= PARALLEL_COMPONENTS_MIN_SIZE)
+	for (int64_t i = 0; i < n; ++i) {
+		context.set_local_index(vertices_begin[i], (uint32_t)i);
+	}
 
-	std::unordered_set<uint32_t> vert_indices_spectral;
-	std::vector<std::vector<uint32_t>> vert_indices_per_set_buffer;
+	UnionFind uf((uint32_t)n);
+#pragma omp taskloop default(shared) grainsize(PARALLEL_COMPONENTS_GRAIN) if(n >= PARALLEL_COMPONENTS_MIN_SIZE)
+	for (int64_t i = 0; i < n; ++i) {
+		const uint32_t* n_end = context.graph.neighbors_end(vertices_begin[i]);
+		for (const uint32_t* u = context.graph.neighbors_begin(vertices_begin[i]); u != n_end; ++u) {
+			const uint32_t j = context.get_local_index(*u, vertices_begin, (uint32_t)n);
+			if (j != NOT_IN_PARTITION) {
+				uf.union_sets((uint32_t)i, j);
+			}
+		}
+	}
 
-	vert_indices_spectral.reserve(vertices_mesh.size() * 3 / 2);
+	std::vector<uint32_t> component_offsets, component_elements;
+	uf.get_sets(&component_offsets, &component_elements);
 
-	// Create root node
-	{
-		OctNodeTask root;
-		root.vertices.resize(context.p_mesh->get_vertices().size());
-		std::iota(root.vertices.begin(), root.vertices.end(), 0);
-		root.depth = 0;
-		root.mid_coord = (maxBBox + minBBox) * 0.5f;
-		tasks.push(std::move(root));
+	if (component_offsets.size() > 2) {
+		for (uint32_t& i : component_elements) {
+			i = vertices_begin[i];
+		}
+		std::copy(component_elements.begin(), component_elements.end(), vertices_begin);
 	}
+	components_timer.stop();
 
-	// Do not create octree if not needed
-	if (tasks.top().vertices.size() < context.max_spectral_size) {
-		vert_indices_spectral.clear();
-		vert_indices_spectral.insert(tasks.top().vertices.begin(), tasks.top().vertices.end());
+	for (size_t c = 0; c + 1 < component_offsets.size(); ++c) {
 		// Spectral classification
 		vertex_laplacian_layout(
 			context,
-			0, // depth
-			vert2face,
-			vert_indices_spectral
+			depth,
+			vertices_begin + component_offsets[c],
+			vertices_begin + component_offsets[c + 1],
+			out
 		);
-		return;
 	}
+}
 
-	// process octree
-	while (!tasks.empty()) {
-		const OctNodeTask task = std::move(tasks.top());
-		tasks.pop();
-
-		const float size_node = octree_size / static_cast<float>(1 << task.depth);
+// Octree node with the vertices vertices[0, num_vertices), in the cube of side
+// size_node centered at mid_coord. The vertices are sorted by octant into
+// scratch, so the children use the two arrays the other way around.
+void octree_node_layout(
+	const LayoutContext& context,
+	uint32_t* vertices,
+	uint32_t* scratch,
+	const uint32_t num_vertices,
+	const Eigen::Vector3f& mid_coord,
+	const float size_node,
+	ClusterList* out) {
 
-		// Clear childs
-		for (auto& v : child_verts)  v.clear();
+	const std::vector<Eigen::Vector3f>& vertices_mesh = context.p_mesh->get_vertices();
 
-		// Classify vertices into the 8 childs
-		for (const uint32_t& i : task.vertices) {
-			const Eigen::Vector3f dir = vertices_mesh[i] - task.mid_coord;
-			uint32_t k =
-				((dir.x() >= 0.f ? 1 : 0) << 0) +
-				((dir.y() >= 0.f ? 1 : 0) << 1) +
-				((dir.z() >= 0.f ? 1 : 0) << 2);
+	auto octant = [&](uint32_t i) {
+		const Eigen::Vector3f dir = vertices_mesh[i] - mid_coord;
+		return
+			((dir.x() >= 0.f ? 1u : 0u) << 0) +
+			((dir.y() >= 0.f ? 1u : 0u) << 1) +
+			((dir.z() >= 0.f ? 1u : 0u) << 2);
+	};
 
-			child_verts[k].push_back(i);
+	// Stable counting sort by octant
+	Profiler::ScopedTimer octree_timer("layout/octree");
+	std::array<uint32_t, 9> child_begin = {};
+	for (uint32_t i = 0; i < num_vertices; ++i) {
+		child_begin[octant(vertices[i]) + 1] += 1;
+	}
+	for (uint32_t k = 0; k < 8; ++k) {
+		child_begin[k + 1] += child_begin[k];
+	}
+	std::array<uint32_t, 8> cursor;
+	std::copy(child_begin.begin(), child_begin.end() - 1, cursor.begin());
+	for (uint32_t i = 0; i < num_vertices; ++i) {
+		scratch[cursor[octant(vertices[i])]++] = vertices[i];
+	}
+	octree_timer.stop();
+
+	// Each child writes its own list, so the ids do not depend on the scheduling
+	std::array<ClusterList, 8> child_out;
+	for (uint32_t k = 0; k < 8; ++k) {
+		const uint32_t begin = child_begin[k];
+		const uint32_t size = child_begin[k + 1] - begin;
+		if (size == 0) {
+			continue;
 		}
 
-		// Keep generating tasks or cluster
-		for (uint32_t k = 0; k < 8; ++k) {
-			if (child_verts[k].empty()) {
-				continue;
-			}
+		if (size < context.max_spectral_size) {
+#pragma omp task default(shared) firstprivate(begin, size, k)
+			components_layout(context, 0, scratch + begin, scratch + begin + size, &child_out[k]);
+		}
+		else {
+			const Eigen::Vector3f dir = { k & 0b1 ? 1.f : -1.f, k & 0b10 ? 1.f : -1.f, k & 0b100 ? 1.f : -1.f };
+			const Eigen::Vector3f child_mid = mid_coord + 0.25f * size_node * dir;
+#pragma omp task default(shared) firstprivate(begin, size, k, child_mid)
+			octree_node_layout(context, scratch + begin, vertices + begin, size,
+				child_mid, 0.5f * size_node, &child_out[k]);
+		}
+	}
 
-			if (child_verts[k].size() < context.max_spectral_size) {
-				UnionFind<uint32_t> uf(child_verts[k]);
-				for (uint32_t v : child_verts[k]) {
-					auto range = vert2face.equal_range(v);
-					std::for_each(range.first, range.second,
-						[&](const std::pair<const uint32_t, uint32_t>& f_id) {
-							const Eigen::Array3i& face = context.p_mesh->get_faces().at(f_id.second);
-							for (uint32_t j = 0; j < 3; ++j) {
-								uint32_t v2 = face[j];
-								if (v2 != v) {
-									uf.union_sets(v, v2);
-								}
-							}
-						}
-					);
-				}
+#pragma omp taskwait
 
-				if (uf.get_num_sets() != 1) {
-					if (vert_indices_per_set_buffer.size() < uf.get_num_sets()) {
-						vert_indices_per_set_buffer.resize(uf.get_num_sets());
-					}
-						uf.get_elements_of_sets(&vert_indices_per_set_buffer);
-						for (const std::vector<uint32_t>& verts : vert_indices_per_set_buffer) {
-							vert_indices_spectral.clear();
-							vert_indices_spectral.insert(verts.begin(), verts.end());
-							// Spectral classification
-							vertex_laplacian_layout(
-								context,
-								0, // depth
-								vert2face,
-								vert_indices_spectral
-							);
-						}
-				}
-				else {
-					vert_indices_spectral.clear();
-					vert_indices_spectral.insert(child_verts[k].begin(), child_verts[k].end());
-					// Spectral classification
-					vertex_laplacian_layout(
-						context,
-						0, // depth
-						vert2face,
-						vert_indices_spectral
-					);
-				}
-			}
-			else {
-				Eigen::Vector3f dir = { k & 0b1 ? 1.f : -1.f, k & 0b10 ? 1.f : -1.f, k & 0b100 ? 1.f : -1.f };
-				OctNodeTask newT;
-				newT.depth = task.depth + 1;
-				newT.mid_coord = task.mid_coord + 0.25f * size_node * dir;
-				newT.vertices = child_verts[k];
-				tasks.push(std::move(newT));
-			}
+	// Leaves first and then the subtrees by decreasing octant, the order of a
+	// depth first traversal with a stack
+	auto is_leaf = [&](uint32_t k) { return child_begin[k + 1] - child_begin[k] < context.max_spectral_size; };
+	for (uint32_t k = 0; k < 8; ++k) {
+		if (is_leaf(k)) {
+			out->insert(out->end(),
+				std::make_move_iterator(child_out[k].begin()), std::make_move_iterator(child_out[k].end()));
 		}
-		
+	}
+	for (int32_t k = 7; k >= 0; --k) {
+		if (!is_leaf(k)) {
+			out->insert(out->end(),
+				std::make_move_iterator(child_out[k].begin()), std::make_move_iterator(child_out[k].end()));
+		}
+	}
+}
+
+void vertex_clustering_layout(
+	LayoutContext& context) {
+	if (context.p_mesh->get_vertices().empty()) {
+		return;
 	}
 
+	const uint32_t num_vertices = (uint32_t)context.p_mesh->get_vertices().size();
+
+	// Permutation of the vertices, partitioned in place by the octree
+	std::vector<uint32_t> vertices(num_vertices);
+	std::iota(vertices.begin(), vertices.end(), 0);
+
+	std::vector<ClusterList> clusters(1);
+
+	// The multilevel solver handles large partitions, only split in components
+	if (context.multilevel) {
+#pragma omp parallel
+#pragma omp single
+		components_layout(context, 0, vertices.data(), vertices.data() + num_vertices, &clusters[0]);
+		context.assign_cluster_ids(clusters);
+		return;
+	}
+
+	// Do not create octree if not needed
+	if (num_vertices < context.max_spectral_size) {
+		// Spectral classification
+#pragma omp parallel
+#pragma omp single
+		components_layout(context, 0, vertices.data(), vertices.data() + num_vertices, &clusters[0]);
+		context.assign_cluster_ids(clusters);
+		return;
+	}
+
+	Eigen::Vector3f minBBox, maxBBox;
+	context.p_mesh->get_bounding_box(&minBBox, &maxBBox);
+
+	const float octree_size = (maxBBox - minBBox).maxCoeff();
+
+	std::vector<uint32_t> scratch(num_vertices);
+
+#pragma omp parallel
+#pragma omp single
+	octree_node_layout(context, vertices.data(), scratch.data(), num_vertices,
+		(maxBBox + minBBox) * 0.5f, octree_size, &clusters[0]);
+
+	context.assign_cluster_ids(clusters);
 }
 
 std::vector<uint32_t>
 get_mapping_optimized_layout(
 	const std::shared_ptr<TriangleMesh> p_mesh,
+	const MeshGraph& graph,
 	const uint32_t max_depth,
 	const uint32_t max_cluster_size,
 	const uint32_t max_spectral_size,
 	const uint32_t max_number_interations_eigen,
-	const float eigen_error)
+	const float eigen_error,
+	const bool warm_start,
+	const bool multilevel,
+	const SplitStrategy split,
+	const uint32_t num_parts,
+	const bool adaptive_eigen,
+	const EigenSolver eigen_solver,
+	ClusteringStats* stats)
 
 {
+	assert(graph.get_num_vertices() == (uint32_t)p_mesh->get_vertices().size());
 
-	uint32_t num_vertices = (uint32_t) p_mesh->get_vertices().size();
-
-	std::unordered_set<uint32_t> vert_indices;
-	vert_indices.reserve(num_vertices);
-	for (uint32_t i = 0; i < num_vertices; ++i) {
-		vert_indices.insert(i);
+	LayoutContext context(p_mesh, graph, max_depth, max_cluster_size, max_spectral_size,
+		max_number_interations_eigen, eigen_error, warm_start, multilevel, split, num_parts, adaptive_eigen, eigen_solver);
+		
+	{
+		Profiler::ScopedTimer timer("layout/clustering");
+		vertex_clustering_layout(context);
 	}
 
-	std::unordered_multimap<uint32_t, uint32_t> vert2face;
-	vert2face.reserve(num_vertices);
-	for (uint32_t f = 0; f < (uint32_t)p_mesh->get_faces().size(); ++f) {
-		for (uint32_t j = 0; j < 3; ++j) {
-			vert2face.insert({ p_mesh->get_faces()[f][j], f});
-		}
-	}
+	Profiler::add_counter("eigen/solves", context.num_solves);
+	Profiler::add_counter("eigen/iterations", context.num_iterations_eigen);
+	Profiler::add_counter("eigen/products", context.num_operations_eigen);
+	Profiler::add_counter("eigen/fallbacks", context.num_fallbacks);
 
-	LayoutContext context(p_mesh, max_depth, max_cluster_size, max_spectral_size,
-		max_number_interations_eigen, eigen_error);
-		
-	vertex_clustering_layout(context, vert2face);
+	if (stats != nullptr) {
+		stats->num_solves = context.num_solves;
+		stats->num_iterations = context.num_iterations_eigen;
+		stats->num_products = context.num_operations_eigen;
+		stats->num_fallbacks = context.num_fallbacks;
+	}
 		
 	return context.final_cluster;
 }
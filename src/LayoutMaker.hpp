@@ -4,15 +4,54 @@
 #include <unordered_map>
 #include <vector>
 #include "TriangleMesh.hpp"
+#include "MeshGraph.hpp"
 
 namespace LayoutMaker {
 
+// Where a partition is split along its Fiedler vector
+enum class SplitStrategy {
+	// Negative and non-negative values
+	Sign,
+	// Two halves of the same size
+	Median,
+	// Threshold with the minimum conductance
+	RatioCut,
+	// The first half gets a multiple of max_cluster_size vertices,
+	// so all clusters but one have exactly max_cluster_size vertices
+	Padded
+};
+
+// Eigen solver of the spectral splits
+enum class EigenSolver {
+	Dense,
+	Lanczos,
+	Lobpcg
+};
+
+// Work of the eigen solver in a clustering, also added to the profiler counters
+struct ClusteringStats {
+	uint64_t num_solves = 0;
+	// Restarts of Lanczos, iterations of LOBPCG
+	uint64_t num_iterations = 0;
+	// Laplacian products
+	uint64_t num_products = 0;
+	uint64_t num_fallbacks = 0;
+};
+
 std::vector<uint32_t> get_mapping_optimized_layout(
 	const std::shared_ptr<TriangleMesh> p_mesh,
+	const MeshGraph& graph,
 	const uint32_t max_depth,
 	const uint32_t max_cluster_size,
 	const uint32_t max_spectral_size,
 	const uint32_t max_number_interations_eigen,
-	const float eigen_error
+	const float eigen_error,
+	const bool warm_start = false,
+	const bool multilevel = false,
+	const SplitStrategy split = SplitStrategy::Sign,
+	const uint32_t num_parts = 2,
+	const bool adaptive_eigen = false,
+	const EigenSolver eigen_solver = EigenSolver::Lanczos,
+	ClusteringStats* stats = nullptr
 );
 }
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "LayoutMetrics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include "MeshGraph.hpp"
+
+namespace LayoutMetrics {
+
+Metrics compute(const TriangleMesh& mesh, const uint32_t cache_line_size, const uint32_t page_size)
+{
+	Metrics m;
+	const MeshGraph graph(mesh);
+	// Position and other attributes, as in the written mesh
+	const uint64_t stride = sizeof(Eigen::Vector3f) + mesh.get_vertex_attributes().stride;
+	const int64_t num_vertices = (int64_t)graph.get_num_vertices();
+
+	double sum_span = 0.0, sum_log = 0.0;
+	uint64_t profile = 0, in_line = 0, in_page = 0;
+	uint32_t bandwidth = 0;
+
+	// Vertex order, each edge counted from its smallest vertex
+#pragma omp parallel for schedule(dynamic, 4096) reduction(+:sum_span, sum_log, profile, in_line, in_page) reduction(max:bandwidth)
+	for (int64_t i = 0; i < num_vertices; ++i) {
+		const uint32_t* n_begin = graph.neighbors_begin((uint32_t)i);
+		const uint32_t* n_end = graph.neighbors_end((uint32_t)i);
+		if (n_begin != n_end && *n_begin < i) {
+			profile += i - *n_begin;
+		}
+		for (const uint32_t* n = std::upper_bound(n_begin, n_end, (uint32_t)i); n != n_end; ++n) {
+			const uint32_t span = *n - (uint32_t)i;
+			sum_span += span;
+			sum_log += std::log2((double)span);
+			bandwidth = std::max(bandwidth, span);
+			in_line += (i * stride) / cache_line_size == (*n * stride) / cache_line_size ? 1 : 0;
+			in_page += (i * stride) / page_size == (*n * stride) / page_size ? 1 : 0;
+		}
+	}
+
+	m.num_edges = graph.get_num_edges();
+	m.bandwidth = bandwidth;
+	m.profile = profile;
+	if (m.num_edges > 0) {
+		m.average_edge_span = sum_span / m.num_edges;
+		m.log_gap = sum_log / m.num_edges;
+		m.edges_in_cache_line = 100.0 * in_line / m.num_edges;
+		m.edges_in_page = 100.0 * in_page / m.num_edges;
+	}
+
+	// Face order
+	const std::vector<Eigen::Array3i>& faces = mesh.get_faces();
+	const int64_t num_faces = (int64_t)faces.size();
+	double sum_spread = 0.0, sum_jump = 0.0;
+	uint64_t faces_line = 0;
+
+#pragma omp parallel for reduction(+:sum_spread, sum_jump, faces_line)
+	for (int64_t f = 0; f < num_faces; ++f) {
+		const int64_t min_v = faces[f].minCoeff();
+		const int64_t max_v = faces[f].maxCoeff();
+		sum_spread += (double)(max_v - min_v);
+		faces_line += (min_v * stride) / cache_line_size == (max_v * stride) / cache_line_size ? 1 : 0;
+		if (f > 0) {
+			sum_jump += (double)std::abs(min_v - (int64_t)faces[f - 1].minCoeff());
+		}
+	}
+
+	if (num_faces > 0) {
+		m.average_face_spread = sum_spread / num_faces;
+		m.faces_in_cache_line = 100.0 * faces_line / num_faces;
+	}
+	if (num_faces > 1) {
+		m.average_face_jump = sum_jump / (num_faces - 1);
+	}
+
+	return m;
+}
+
+void print(const Metrics& m, const char* title)
+{
+	std::cout << title << " layout metrics:\n"
+		"\tEdges: " << m.num_edges << "\n"
+		"\tAverage edge span: " << m.average_edge_span << "\n"
+		"\tBandwidth: " << m.bandwidth << "\n"
+		"\tProfile: " << m.profile << "\n"
+		"\tLog gap (COML): " << m.log_gap << "\n"
+		"\tEdges in cache line: " << m.edges_in_cache_line << " %\n"
+		"\tEdges in page: " << m.edges_in_page << " %\n"
+		"\tAverage face spread: " << m.average_face_spread << "\n"
+		"\tAverage face jump: " << m.average_face_jump << "\n"
+		"\tFaces in cache line: " << m.faces_in_cache_line << " %" << std::endl;
+}
+
+} // namespace
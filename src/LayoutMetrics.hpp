@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include "TriangleMesh.hpp"
+
+namespace LayoutMetrics {
+
+struct Metrics {
+	uint64_t num_edges = 0;
+	// |i - j| over the edges (i, j)
+	double average_edge_span = 0.0;
+	uint32_t bandwidth = 0;
+	// Sum over the vertices of the distance to its first neighbor
+	uint64_t profile = 0;
+	// Cache-oblivious metric: average of log2 |i - j| over the edges (Yoon & Lindstrom)
+	double log_gap = 0.0;
+	// Percentage of edges with both vertices in the same window of the vertex buffer
+	double edges_in_cache_line = 0.0;
+	double edges_in_page = 0.0;
+
+	// Average of max - min vertex index of each face
+	double average_face_spread = 0.0;
+	// Average distance between the smallest index of consecutive faces
+	double average_face_jump = 0.0;
+	// Percentage of faces with all the vertices in the same cache line
+	double faces_in_cache_line = 0.0;
+};
+
+// Metrics of the current vertex and face order of the mesh.
+// Windows are measured in bytes of the vertex buffer.
+Metrics compute(const TriangleMesh& mesh,
+	const uint32_t cache_line_size = 64, const uint32_t page_size = 4096);
+
+void print(const Metrics& metrics, const char* title);
+
+} // namespace
@@ -1,36 +1,275 @@
 #include "LayoutOptimizer.hpp"
 
-#include <unordered_set>
+#include <algorithm>
+#include <bitset>
+#include <limits>
+#include <numeric>
+#include "CuthillMcKee.hpp"
+#include "Profiler.hpp"
 
 namespace LayoutOptimizer {
 
+// The tables of the exact solver take 7 * 2^n bytes per thread, 1.8 MB at this size.
+// Larger clusters use the heuristic.
+constexpr uint32_t MAX_EXACT_CLUSTER_SIZE_LIMIT = 18;
 
-struct Edge {
-	Edge(uint32_t v0, uint32_t v1) {
-		d = std::minmax(v0, v1);
+// Heuristic: number of sifting passes and how far a vertex can move in one
+constexpr uint32_t SIFTING_PASSES = 4;
+constexpr uint32_t SIFTING_WINDOW = 16;
+
+// Buffers reused between the clusters of a thread
+struct OrderingBuffers {
+	std::vector<uint32_t> cost;
+	std::vector<uint16_t> cut;
+	std::vector<uint8_t> last;
+	std::vector<uint32_t> pos;
+};
+
+// Edges between the vertices of the cluster, in local indices
+static void cluster_subgraph(const MeshGraph& graph, const std::vector<uint32_t>& cluster, WeightedGraph* out)
+{
+	out->offsets.assign(1, 0);
+	out->neighbors.clear();
+	out->weights.clear();
+	for (uint32_t v : cluster) {
+		const uint32_t* n_end = graph.neighbors_end(v);
+		for (const uint32_t* n = graph.neighbors_begin(v); n != n_end; ++n) {
+			// cluster is sorted
+			const auto it = std::lower_bound(cluster.begin(), cluster.end(), *n);
+			if (it != cluster.end() && *it == *n) {
+				out->neighbors.push_back((uint32_t)(it - cluster.begin()));
+			}
+		}
+		out->offsets.push_back((uint32_t)out->neighbors.size());
 	}
+}
+
+// Minimum linear arrangement by dynamic programming over subsets.
+// The span of an order is the sum of the cuts between each prefix and the rest,
+// so cost(S) = cut(S) + min over v in S of cost(S - v), where v is placed last.
+static void exact_min_span_order(const WeightedGraph& g, OrderingBuffers* buf, std::vector<uint32_t>* order)
+{
+	const uint32_t n = g.get_num_vertices();
+	assert(n <= MAX_EXACT_CLUSTER_SIZE_LIMIT);
+	const uint32_t full = (1u << n) - 1;
 
-	bool operator==(const Edge& o) const {
-		return d.first == o.d.first && d.second == o.d.second;
+	std::vector<uint32_t> adj(n, 0);
+	for (uint32_t v = 0; v < n; ++v) {
+		for (uint32_t i = g.offsets[v]; i < g.offsets[v + 1]; ++i) {
+			adj[v] |= 1u << g.neighbors[i];
+		}
 	}
 
-	std::pair<uint32_t, uint32_t> d;
-};
+	buf->cost.resize((size_t)full + 1);
+	buf->cut.resize((size_t)full + 1);
+	buf->last.resize((size_t)full + 1);
+	buf->cost[0] = 0;
+	buf->cut[0] = 0;
 
-struct EdgeHash {
-	size_t operator()(const Edge& e) const
-	{
-		size_t hash1 = std::hash<uint32_t>{}(e.d.first);
-		size_t hash2 = std::hash<uint32_t>{}(e.d.second);
-		return hash1 ^ hash2;
+	for (uint32_t s = 1; s <= full; ++s) {
+		// Cut from the set without its lowest vertex
+		uint32_t low = 0;
+		while (((s >> low) & 1u) == 0) {
+			low += 1;
+		}
+		const uint32_t s0 = s & (s - 1);
+		buf->cut[s] = (uint16_t)(buf->cut[s0] + std::bitset<32>(adj[low]).count()
+			- 2 * std::bitset<32>(adj[low] & s0).count());
+
+		uint32_t best = std::numeric_limits<uint32_t>::max();
+		uint8_t best_v = 0;
+		for (uint32_t v = 0; v < n; ++v) {
+			if ((s >> v) & 1u) {
+				const uint32_t c = buf->cost[s & ~(1u << v)];
+				if (c < best) {
+					best = c;
+					best_v = (uint8_t)v;
+				}
+			}
+		}
+		buf->cost[s] = best + buf->cut[s];
+		buf->last[s] = best_v;
 	}
-};
 
-std::vector<uint32_t> optimize_layout(const TriangleMesh& mesh, const std::vector<uint32_t>& clusters)
+	order->resize(n);
+	uint32_t s = full;
+	for (uint32_t i = n; i > 0; --i) {
+		const uint32_t v = buf->last[s];
+		(*order)[i - 1] = v;
+		s &= ~(1u << v);
+	}
+}
+
+// Change of span when swapping the vertices at positions i and i + 1, and do it
+static int64_t swap_adjacent(const WeightedGraph& g, uint32_t i, std::vector<uint32_t>* order, std::vector<uint32_t>* pos)
+{
+	const uint32_t a = (*order)[i];
+	const uint32_t b = (*order)[i + 1];
+	int64_t delta = 0;
+	for (uint32_t k = g.offsets[a]; k < g.offsets[a + 1]; ++k) {
+		const uint32_t p = (*pos)[g.neighbors[k]];
+		delta += p < i ? 1 : (p > i + 1 ? -1 : 0);
+	}
+	for (uint32_t k = g.offsets[b]; k < g.offsets[b + 1]; ++k) {
+		const uint32_t p = (*pos)[g.neighbors[k]];
+		delta += p > i + 1 ? 1 : (p < i ? -1 : 0);
+	}
+	std::swap((*order)[i], (*order)[i + 1]);
+	(*pos)[a] = i + 1;
+	(*pos)[b] = i;
+	return delta;
+}
+
+// Breadth first order from a vertex of minimum degree, improved by sifting:
+// each vertex is moved to the position within a window that reduces the span the most.
+static void heuristic_min_span_order(const WeightedGraph& g, OrderingBuffers* buf, std::vector<uint32_t>* order)
+{
+	const uint32_t n = g.get_num_vertices();
+	const uint32_t unvisited = std::numeric_limits<uint32_t>::max();
+
+	std::vector<uint32_t>& pos = buf->pos;
+	pos.assign(n, unvisited);
+	order->clear();
+
+	// Initial order, for each connected component
+	while (order->size() < n) {
+		uint32_t start = unvisited;
+		for (uint32_t v = 0; v < n; ++v) {
+			if (pos[v] == unvisited && (start == unvisited || g.offsets[v + 1] - g.offsets[v] < g.offsets[start + 1] - g.offsets[start])) {
+				start = v;
+			}
+		}
+		pos[start] = (uint32_t)order->size();
+		order->push_back(start);
+		for (uint32_t q = pos[start]; q < (uint32_t)order->size(); ++q) {
+			const uint32_t v = (*order)[q];
+			for (uint32_t k = g.offsets[v]; k < g.offsets[v + 1]; ++k) {
+				const uint32_t u = g.neighbors[k];
+				if (pos[u] == unvisited) {
+					pos[u] = (uint32_t)order->size();
+					order->push_back(u);
+				}
+			}
+		}
+	}
+
+	// Sifting
+	for (uint32_t pass = 0; pass < SIFTING_PASSES; ++pass) {
+		bool improved = false;
+		for (uint32_t v = 0; v < n; ++v) {
+			const uint32_t p = pos[v];
+			const uint32_t lo = p > SIFTING_WINDOW ? p - SIFTING_WINDOW : 0;
+			const uint32_t hi = std::min(n - 1, p + SIFTING_WINDOW);
+
+			int64_t delta = 0;
+			int64_t best_delta = 0;
+			uint32_t best_pos = p;
+			// Move to the left of the window
+			for (uint32_t i = p; i > lo; --i) {
+				delta += swap_adjacent(g, i - 1, order, &pos);
+				if (delta < best_delta) {
+					best_delta = delta;
+					best_pos = i - 1;
+				}
+			}
+			// And to the right
+			for (uint32_t i = lo; i < hi; ++i) {
+				delta += swap_adjacent(g, i, order, &pos);
+				if (delta < best_delta) {
+					best_delta = delta;
+					best_pos = i + 1;
+				}
+			}
+			// Back to the best position
+			for (uint32_t i = hi; i > best_pos; --i) {
+				swap_adjacent(g, i - 1, order, &pos);
+			}
+
+			improved = improved || best_delta < 0;
+		}
+		if (!improved) {
+			break;
+		}
+	}
+}
+
+// Graph of the clusters, weighted by the number of mesh edges between them
+static void cluster_quotient_graph(const MeshGraph& graph, const std::vector<uint32_t>& clusters,
+	const uint32_t num_clusters, WeightedGraph* out)
+{
+	std::vector<std::pair<uint32_t, uint32_t>> pairs;
+	for (uint32_t v = 0; v < graph.get_num_vertices(); ++v) {
+		const uint32_t* n_end = graph.neighbors_end(v);
+		for (const uint32_t* n = graph.neighbors_begin(v); n != n_end; ++n) {
+			if (clusters[v] != clusters[*n]) {
+				pairs.push_back({ clusters[v], clusters[*n] });
+			}
+		}
+	}
+	std::sort(pairs.begin(), pairs.end());
+
+	out->offsets.assign(num_clusters + 1, 0);
+	out->neighbors.clear();
+	out->weights.clear();
+	for (size_t i = 0; i < pairs.size(); ++i) {
+		if (i > 0 && pairs[i] == pairs[i - 1]) {
+			out->weights.back() += 1.0f;
+		}
+		else {
+			out->neighbors.push_back(pairs[i].second);
+			out->weights.push_back(1.0f);
+			out->offsets[pairs[i].first + 1] += 1;
+		}
+	}
+	for (uint32_t c = 0; c < num_clusters; ++c) {
+		out->offsets[c + 1] += out->offsets[c];
+	}
+}
+
+// Reverse the order of a cluster when this shortens the edges to the other clusters
+static void orient_clusters(const MeshGraph& graph, const std::vector<uint32_t>& cluster_order,
+	const std::vector<uint32_t>& offsets, const std::vector<std::vector<uint32_t>>& cluster_to_vert,
+	std::vector<uint32_t>* new_layout)
+{
+	std::vector<uint32_t> pos(new_layout->size());
+	for (uint32_t i = 0; i < (uint32_t)new_layout->size(); ++i) {
+		pos[(*new_layout)[i]] = i;
+	}
+
+	for (uint32_t c : cluster_order) {
+		const uint32_t begin = offsets[c];
+		const uint32_t end = begin + (uint32_t)cluster_to_vert[c].size();
+		int64_t cost_forward = 0, cost_reversed = 0;
+		for (uint32_t i = begin; i < end; ++i) {
+			const uint32_t v = (*new_layout)[i];
+			const int64_t i_reversed = (int64_t)begin + end - 1 - i;
+			const uint32_t* n_end = graph.neighbors_end(v);
+			for (const uint32_t* n = graph.neighbors_begin(v); n != n_end; ++n) {
+				const int64_t p = pos[*n];
+				if (p < begin || p >= end) {
+					cost_forward += std::abs(p - (int64_t)i);
+					cost_reversed += std::abs(p - i_reversed);
+				}
+			}
+		}
+		if (cost_reversed < cost_forward) {
+			std::reverse(new_layout->begin() + begin, new_layout->begin() + end);
+			for (uint32_t i = begin; i < end; ++i) {
+				pos[(*new_layout)[i]] = i;
+			}
+		}
+	}
+}
+
+std::vector<uint32_t> optimize_layout(const MeshGraph& graph, const std::vector<uint32_t>& clusters,
+	const uint32_t max_exact_cluster_size, const bool order_clusters)
 {
 	assert(!clusters.empty());
-	assert(mesh.get_vertices().size() == clusters.size());
+	assert(graph.get_num_vertices() == (uint32_t)clusters.size());
+
+	const uint32_t max_exact_size = std::min(max_exact_cluster_size, MAX_EXACT_CLUSTER_SIZE_LIMIT);
 
+	// Vertex at each new position
 	std::vector<uint32_t> new_layout(clusters.size(), std::numeric_limits<uint32_t>::max());
 
 	const int32_t num_clusters = 1 + *std::max_element(clusters.begin(), clusters.end());
@@ -41,59 +280,63 @@ std::vector<uint32_t> optimize_layout(const TriangleMesh& mesh, const std::vecto
 		cluster_to_vert[clusters[i]].push_back(i);
 	}
 
-	// Create set with all the edges
-	std::unordered_set<Edge, EdgeHash> edges_set;
-	edges_set.reserve((mesh.get_faces().size() * 3) / 2);
-	for (const Eigen::Array3i& face : mesh.get_faces()) {
-		for (uint32_t i = 0; i < 3; ++i) {
-			Edge edge(face[i], face[(i + 1) % 3]);
-			edges_set.insert(edge);
-		}
+	// Sequence of the clusters in memory
+	std::vector<uint32_t> cluster_order(num_clusters);
+	if (order_clusters) {
+		Profiler::ScopedTimer timer("optimizer/cluster_order");
+		WeightedGraph quotient;
+		cluster_quotient_graph(graph, clusters, num_clusters, &quotient);
+		cluster_order = CuthillMcKee::cuthill_mckee_order(quotient);
+	}
+	else {
+		std::iota(cluster_order.begin(), cluster_order.end(), 0);
 	}
 
 	std::vector<uint32_t> offsets(num_clusters, 0);
 	for (uint32_t i = 1; i < (uint32_t)num_clusters; ++i) {
-		offsets[i] = (uint32_t)cluster_to_vert[i - 1].size() + offsets[i - 1];
+		offsets[cluster_order[i]] = (uint32_t)cluster_to_vert[cluster_order[i - 1]].size() + offsets[cluster_order[i - 1]];
 	}
 
-	std::vector<uint32_t> tmp;
+	Profiler::ScopedTimer intra_timer("optimizer/intra_cluster_order");
+	WeightedGraph subgraph;
+	OrderingBuffers buffers;
+	std::vector<uint32_t> order;
 
-#pragma omp parallel for schedule(dynamic) firstprivate(tmp)
+#pragma omp parallel for schedule(dynamic) firstprivate(subgraph, buffers, order)
 	for (int32_t c = 0; c < num_clusters; ++c) {
-		std::vector<uint32_t>& cluster = cluster_to_vert[c];
+		const std::vector<uint32_t>& cluster = cluster_to_vert[c];
 		const uint32_t cluster_size = (uint32_t)cluster.size();
-		// Just in case, skip if too large
-		if (cluster_size > 15) {
-			std::copy(cluster.begin(), cluster.end(), new_layout.data() + offsets[c]);
-			continue;
-		}
-		tmp.clear();
-
-		int32_t edge_span = std::numeric_limits<int32_t>::max();
-		do {
-			int32_t new_edge_span = 0;
-			for (uint32_t i = 0; i < cluster_size; ++i) {
-				for (uint32_t j = i + 1; j < cluster_size; ++j) {
-					// if edge is contained
-					if (edges_set.count(Edge(cluster[i], cluster[j]))) {
-						new_edge_span += j - i;
-					}
-				}
-			}
 
-			if (new_edge_span < edge_span) {
-				edge_span = new_edge_span;
-				tmp = cluster;
-			}
+		cluster_subgraph(graph, cluster, &subgraph);
+
+		if (cluster_size <= max_exact_size) {
+			exact_min_span_order(subgraph, &buffers, &order);
+		}
+		else {
+			heuristic_min_span_order(subgraph, &buffers, &order);
+		}
 
-		} while (std::next_permutation(cluster.begin(), cluster.end()));
+		assert((uint32_t)order.size() == cluster_size);
 
-		std::copy(tmp.begin(), tmp.end(), new_layout.data() + offsets[c]);
+		for (uint32_t i = 0; i < cluster_size; ++i) {
+			new_layout[offsets[c] + i] = cluster[order[i]];
+		}
+	}
+
+	intra_timer.stop();
+
+	if (order_clusters) {
+		Profiler::ScopedTimer timer("optimizer/orient_clusters");
+		orient_clusters(graph, cluster_order, offsets, cluster_to_vert, &new_layout);
+	}
 
-		assert((uint32_t)tmp.size() == cluster_size);
+	// New position of each vertex
+	std::vector<uint32_t> old2new(new_layout.size());
+	for (uint32_t i = 0; i < (uint32_t)new_layout.size(); ++i) {
+		old2new[new_layout[i]] = i;
 	}
 
-	return new_layout;
+	return old2new;
 }
 
-} // namespace
\ No newline at end of file
+} // namespace
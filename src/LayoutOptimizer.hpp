@@ -1,10 +1,16 @@
 #pragma once
 
-#include "TriangleMesh.hpp"
+#include "MeshGraph.hpp"
 
 namespace LayoutOptimizer {
 
-// Get mapping of vertices to new, better positions
-std::vector<uint32_t> optimize_layout(const TriangleMesh& mesh, const std::vector<uint32_t>& clusters);
+// Get mapping of vertices to new, better positions.
+// Clusters of up to max_exact_cluster_size vertices (at most 18) get the order
+// with minimum edge span, larger ones a heuristic order.
+// If order_clusters, the clusters follow a Cuthill-McKee order of the cluster
+// adjacency graph and each one is oriented towards its neighbors, otherwise
+// they are placed by id.
+std::vector<uint32_t> optimize_layout(const MeshGraph& graph, const std::vector<uint32_t>& clusters,
+	const uint32_t max_exact_cluster_size = 16, const bool order_clusters = true);
 
 } // namespace
\ No newline at end of file
@@ -0,0 +1,92 @@
+#include "MappedFile.hpp"
+
+#include <stdexcept>
+#include <string>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile(const char* path)
+{
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Error: Can't open file " + std::string(path));
+	}
+	m_file = file;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		release();
+		throw std::runtime_error("Error: Can't open file " + std::string(path));
+	}
+	m_size = (size_t)size.QuadPart;
+	if (m_size > 0) {
+		m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m_mapping) {
+			m_data = (const char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+		}
+		if (!m_data) {
+			release();
+			throw std::runtime_error("Error: Can't map file " + std::string(path));
+		}
+	}
+}
+
+void MappedFile::release()
+{
+	if (m_data) {
+		UnmapViewOfFile(m_data);
+		m_data = nullptr;
+	}
+	if (m_mapping) {
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+	}
+	if (m_file) {
+		CloseHandle(m_file);
+		m_file = nullptr;
+	}
+}
+
+#else
+
+MappedFile::MappedFile(const char* path)
+{
+	const int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("Error: Can't open file " + std::string(path));
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		throw std::runtime_error("Error: Can't open file " + std::string(path));
+	}
+	m_size = (size_t)info.st_size;
+	if (m_size > 0) {
+		void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			close(fd);
+			throw std::runtime_error("Error: Can't map file " + std::string(path));
+		}
+		// The whole file is read, start paging it in
+		madvise(data, m_size, MADV_WILLNEED);
+		m_data = (const char*)data;
+	}
+	close(fd);
+}
+
+void MappedFile::release()
+{
+	if (m_data) {
+		munmap((void*)m_data, m_size);
+		m_data = nullptr;
+	}
+}
+
+#endif
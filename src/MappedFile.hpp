@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+
+// Read only memory mapping of a whole file.
+// Throws if the file cannot be opened or mapped.
+class MappedFile {
+public:
+	explicit MappedFile(const char* path);
+
+	~MappedFile() {
+		release();
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const char* data() const {
+		return m_data;
+	}
+
+	size_t size() const {
+		return m_size;
+	}
+
+private:
+	void release();
+
+	const char* m_data = nullptr;
+	size_t m_size = 0;
+#if defined(_WIN32)
+	// Handles of the file and the mapping
+	void* m_file = nullptr;
+	void* m_mapping = nullptr;
+#endif
+};
@@ -0,0 +1,83 @@
+#include "MeshGraph.hpp"
+
+#include <algorithm>
+#include "Profiler.hpp"
+
+MeshGraph::MeshGraph(const TriangleMesh& mesh)
+{
+	Profiler::ScopedTimer timer("graph/build");
+	const std::vector<Eigen::Array3i>& faces = mesh.get_faces();
+	const uint32_t num_vertices = (uint32_t)mesh.get_vertices().size();
+	const int64_t num_faces = (int64_t)faces.size();
+
+	// Each incident face gives (at most) two neighbors.
+	// Degenerate faces repeat a vertex, which is not its own neighbor.
+	std::vector<uint64_t> tmp_offsets(num_vertices + 1, 0);
+#pragma omp parallel for
+	for (int64_t f = 0; f < num_faces; ++f) {
+		for (uint32_t j = 0; j < 3; ++j) {
+			const uint32_t v = faces[f][j];
+			const uint64_t count = ((uint32_t)faces[f][(j + 1) % 3] != v) + ((uint32_t)faces[f][(j + 2) % 3] != v);
+#pragma omp atomic
+			tmp_offsets[v + 1] += count;
+		}
+	}
+	for (uint32_t v = 0; v < num_vertices; ++v) {
+		tmp_offsets[v + 1] += tmp_offsets[v];
+	}
+
+	// Scatter the neighbors of each face, with duplicates
+	std::vector<uint32_t> tmp_neighbors(tmp_offsets.back());
+	std::vector<uint64_t> cursor(tmp_offsets.begin(), tmp_offsets.end() - 1);
+#pragma omp parallel for
+	for (int64_t f = 0; f < num_faces; ++f) {
+		for (uint32_t j = 0; j < 3; ++j) {
+			const uint32_t v = faces[f][j];
+			const uint32_t v1 = faces[f][(j + 1) % 3];
+			const uint32_t v2 = faces[f][(j + 2) % 3];
+			const uint64_t count = (v1 != v) + (v2 != v);
+			uint64_t pos;
+#pragma omp atomic capture
+			{ pos = cursor[v]; cursor[v] += count; }
+			if (v1 != v) {
+				tmp_neighbors[pos++] = v1;
+			}
+			if (v2 != v) {
+				tmp_neighbors[pos] = v2;
+			}
+		}
+	}
+
+	// Sort and remove duplicates per vertex. cursor now holds the unique degree.
+#pragma omp parallel for schedule(dynamic, 1024)
+	for (int64_t v = 0; v < (int64_t)num_vertices; ++v) {
+		uint32_t* begin = tmp_neighbors.data() + tmp_offsets[v];
+		uint32_t* end = tmp_neighbors.data() + tmp_offsets[v + 1];
+		std::sort(begin, end);
+		cursor[v] = std::unique(begin, end) - begin;
+	}
+
+	// Compact
+	m_offsets.resize(num_vertices + 1);
+	m_offsets[0] = 0;
+	for (uint32_t v = 0; v < num_vertices; ++v) {
+		m_offsets[v + 1] = m_offsets[v] + cursor[v];
+	}
+
+	m_neighbors.resize(m_offsets.back());
+#pragma omp parallel for schedule(dynamic, 1024)
+	for (int64_t v = 0; v < (int64_t)num_vertices; ++v) {
+		std::copy(tmp_neighbors.begin() + tmp_offsets[v],
+			tmp_neighbors.begin() + tmp_offsets[v] + cursor[v],
+			m_neighbors.begin() + m_offsets[v]);
+	}
+}
+
+bool MeshGraph::has_edge(uint32_t v0, uint32_t v1) const
+{
+	// search in the smallest list
+	if (degree(v0) > degree(v1)) {
+		std::swap(v0, v1);
+	}
+	return std::binary_search(neighbors_begin(v0), neighbors_end(v0), v1);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "TriangleMesh.hpp"
+
+// Vertex-vertex adjacency of a triangle mesh stored in CSR form.
+// The neighbors of vertex v are neighbors[offsets[v] .. offsets[v + 1]),
+// sorted and without duplicates.
+class MeshGraph {
+public:
+	MeshGraph(const TriangleMesh& mesh);
+
+	uint32_t get_num_vertices() const {
+		return (uint32_t)m_offsets.size() - 1;
+	}
+
+	// Number of undirected edges
+	uint64_t get_num_edges() const {
+		return m_neighbors.size() / 2;
+	}
+
+	uint32_t degree(uint32_t v) const {
+		return (uint32_t)(m_offsets[v + 1] - m_offsets[v]);
+	}
+
+	const uint32_t* neighbors_begin(uint32_t v) const {
+		return m_neighbors.data() + m_offsets[v];
+	}
+
+	const uint32_t* neighbors_end(uint32_t v) const {
+		return m_neighbors.data() + m_offsets[v + 1];
+	}
+
+	bool has_edge(uint32_t v0, uint32_t v1) const;
+
+	const std::vector<uint64_t>& get_offsets() const {
+		return m_offsets;
+	}
+
+	const std::vector<uint32_t>& get_neighbors() const {
+		return m_neighbors;
+	}
+
+private:
+	std::vector<uint64_t> m_offsets;
+	std::vector<uint32_t> m_neighbors;
+};
+
+// Graph with local indices and edge weights, in CSR form.
+// Used for the partitions of the mesh and their coarse versions.
+// Empty weights mean that all edges have weight 1.
+struct WeightedGraph {
+	std::vector<uint32_t> offsets;
+	std::vector<uint32_t> neighbors;
+	std::vector<float> weights;
+
+	uint32_t get_num_vertices() const {
+		return offsets.empty() ? 0 : (uint32_t)offsets.size() - 1;
+	}
+
+	uint32_t degree(uint32_t v) const {
+		return offsets[v + 1] - offsets[v];
+	}
+
+	const uint32_t* neighbors_begin(uint32_t v) const {
+		return neighbors.data() + offsets[v];
+	}
+
+	const uint32_t* neighbors_end(uint32_t v) const {
+		return neighbors.data() + offsets[v + 1];
+	}
+
+	// Weight of the i-th entry of neighbors
+	float weight(uint32_t i) const {
+		return weights.empty() ? 1.0f : weights[i];
+	}
+
+	// Sum of the weights of the edges of v
+	float weighted_degree(uint32_t v) const {
+		if (weights.empty()) {
+			return (float)(offsets[v + 1] - offsets[v]);
+		}
+		float d = 0.0f;
+		for (uint32_t i = offsets[v]; i < offsets[v + 1]; ++i) {
+			d += weights[i];
+		}
+		return d;
+	}
+};
@@ -0,0 +1,250 @@
+#include "PermutationFile.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include "MappedFile.hpp"
+
+namespace PermutationFile {
+
+static const char MAGIC[8] = { 'M', 'L', 'O', 'P', 'E', 'R', 'M', '\0' };
+
+constexpr uint32_t FLAG_VERTICES = 1 << 0;
+constexpr uint32_t FLAG_FACE_ORDER = 1 << 1;
+constexpr uint32_t FLAG_FACE_ROTATION = 1 << 2;
+constexpr uint32_t FLAG_COMPRESSED = 1 << 3;
+
+// Appends the value in little endian, whatever the host order
+template<typename T>
+static void append(T value, std::vector<char>* out)
+{
+	for (size_t i = 0; i < sizeof(T); ++i) {
+		out->push_back((char)(uint8_t)(value >> (8 * i)));
+	}
+}
+
+// Value stored in little endian at data
+template<typename T>
+static T load(const char* data)
+{
+	T value = 0;
+	for (size_t i = 0; i < sizeof(T); ++i) {
+		value |= (T)(uint8_t)data[i] << (8 * i);
+	}
+	return value;
+}
+
+static void encode_array(const std::vector<uint32_t>& values, bool compress, std::vector<char>* out)
+{
+	if (!compress) {
+		out->reserve(out->size() + values.size() * sizeof(uint32_t));
+		for (const uint32_t value : values) {
+			append(value, out);
+		}
+		return;
+	}
+	int64_t previous = 0;
+	for (const uint32_t value : values) {
+		const int64_t delta = (int64_t)value - previous;
+		previous = value;
+		uint64_t zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+		while (zigzag >= 0x80) {
+			out->push_back((char)(zigzag | 0x80));
+			zigzag >>= 7;
+		}
+		out->push_back((char)zigzag);
+	}
+}
+
+// Fills the size of the section that starts at size_position
+static void end_section(size_t size_position, std::vector<char>* out)
+{
+	const uint64_t size = out->size() - size_position - sizeof(uint64_t);
+	for (size_t i = 0; i < sizeof(size); ++i) {
+		(*out)[size_position + i] = (char)(uint8_t)(size >> (8 * i));
+	}
+}
+
+std::vector<char> encode(const MeshPermutation& permutation,
+	uint64_t num_vertices, uint64_t num_faces, bool compress)
+{
+	assert(permutation.vertex_old2new.empty() || permutation.vertex_old2new.size() == num_vertices);
+	assert(permutation.face_order.empty() || permutation.face_order.size() == num_faces);
+	assert(permutation.face_rotation.empty() || permutation.face_rotation.size() == num_faces);
+
+	uint32_t flags = compress ? FLAG_COMPRESSED : 0;
+	flags |= permutation.vertex_old2new.empty() ? 0 : FLAG_VERTICES;
+	flags |= permutation.face_order.empty() ? 0 : FLAG_FACE_ORDER;
+	flags |= permutation.face_rotation.empty() ? 0 : FLAG_FACE_ROTATION;
+
+	std::vector<char> out(MAGIC, MAGIC + sizeof(MAGIC));
+	append(VERSION, &out);
+	append(flags, &out);
+	append(num_vertices, &out);
+	append(num_faces, &out);
+
+	if (flags & FLAG_VERTICES) {
+		const size_t size_position = out.size();
+		append(uint64_t(0), &out);
+		encode_array(permutation.vertex_old2new, compress, &out);
+		end_section(size_position, &out);
+	}
+	if (flags & FLAG_FACE_ORDER) {
+		const size_t size_position = out.size();
+		append(uint64_t(0), &out);
+		encode_array(permutation.face_order, compress, &out);
+		end_section(size_position, &out);
+	}
+	if (flags & FLAG_FACE_ROTATION) {
+		// Four rotations per byte
+		append(uint64_t((num_faces + 3) / 4), &out);
+		const size_t begin = out.size();
+		out.resize(begin + (num_faces + 3) / 4, 0);
+		for (uint64_t f = 0; f < num_faces; ++f) {
+			out[begin + f / 4] |= (char)(permutation.face_rotation[f] << (2 * (f % 4)));
+		}
+	}
+	return out;
+}
+
+void write(const char* path, const MeshPermutation& permutation,
+	uint64_t num_vertices, uint64_t num_faces, bool compress)
+{
+	const std::vector<char> data = encode(permutation, num_vertices, num_faces, compress);
+	std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+	stream.write(data.data(), data.size());
+	if (!stream) {
+		throw std::runtime_error("Error: Can't write file " + std::string(path));
+	}
+}
+
+static std::runtime_error invalid_file(const char* name)
+{
+	return std::runtime_error("Error: Invalid permutation " + std::string(name));
+}
+
+// Decodes count entries and checks that they are a permutation
+static std::vector<uint32_t> decode_array(const char* data, uint64_t size, uint64_t count, bool compressed, const char* name)
+{
+	std::vector<uint32_t> values(count);
+	if (!compressed) {
+		if (size != count * sizeof(uint32_t)) {
+			throw invalid_file(name);
+		}
+		for (uint64_t i = 0; i < count; ++i) {
+			values[i] = load<uint32_t>(data + i * sizeof(uint32_t));
+		}
+	}
+	else {
+		const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+		const uint8_t* const end = p + size;
+		int64_t previous = 0;
+		for (uint64_t i = 0; i < count; ++i) {
+			uint64_t zigzag = 0;
+			uint32_t shift = 0;
+			uint8_t byte;
+			do {
+				if (p == end || shift > 63) {
+					throw invalid_file(name);
+				}
+				byte = *p++;
+				zigzag |= (uint64_t)(byte & 0x7f) << shift;
+				shift += 7;
+			} while (byte & 0x80);
+			previous += (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+			if (previous < 0 || previous >= (int64_t)count) {
+				throw invalid_file(name);
+			}
+			values[i] = (uint32_t)previous;
+		}
+		if (p != end) {
+			throw invalid_file(name);
+		}
+	}
+
+	std::vector<bool> seen(count, false);
+	for (const uint32_t v : values) {
+		if (v >= count || seen[v]) {
+			throw invalid_file(name);
+		}
+		seen[v] = true;
+	}
+	return values;
+}
+
+MeshPermutation decode(const char* data, size_t size, const char* name,
+	uint64_t* num_vertices, uint64_t* num_faces)
+{
+	if (size < sizeof(MAGIC) || std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0) {
+		throw invalid_file(name);
+	}
+	size_t offset = sizeof(MAGIC);
+	auto read_value = [&](auto* out) {
+		if (size - offset < sizeof(*out)) {
+			throw invalid_file(name);
+		}
+		*out = load<std::remove_pointer_t<decltype(out)>>(data + offset);
+		offset += sizeof(*out);
+	};
+
+	uint32_t version, flags;
+	read_value(&version);
+	read_value(&flags);
+	read_value(num_vertices);
+	read_value(num_faces);
+	if (version == 0 || version > VERSION ||
+		*num_vertices > std::numeric_limits<uint32_t>::max() || *num_faces > std::numeric_limits<uint32_t>::max()) {
+		throw invalid_file(name);
+	}
+	const bool compressed = (flags & FLAG_COMPRESSED) != 0;
+
+	// Size of the next section, checked against the file
+	auto section_size = [&]() {
+		uint64_t section;
+		read_value(&section);
+		if (size - offset < section) {
+			throw invalid_file(name);
+		}
+		return section;
+	};
+
+	MeshPermutation permutation;
+	if (flags & FLAG_VERTICES) {
+		const uint64_t section = section_size();
+		permutation.vertex_old2new = decode_array(data + offset, section, *num_vertices, compressed, name);
+		offset += section;
+	}
+	if (flags & FLAG_FACE_ORDER) {
+		const uint64_t section = section_size();
+		permutation.face_order = decode_array(data + offset, section, *num_faces, compressed, name);
+		offset += section;
+	}
+	if (flags & FLAG_FACE_ROTATION) {
+		const uint64_t section = section_size();
+		if (section != (*num_faces + 3) / 4) {
+			throw invalid_file(name);
+		}
+		permutation.face_rotation.resize(*num_faces);
+		for (uint64_t f = 0; f < *num_faces; ++f) {
+			const uint8_t rotation = ((uint8_t)data[offset + f / 4] >> (2 * (f % 4))) & 3;
+			if (rotation > 2) {
+				throw invalid_file(name);
+			}
+			permutation.face_rotation[f] = rotation;
+		}
+		offset += section;
+	}
+	return permutation;
+}
+
+MeshPermutation read(const char* path, uint64_t* num_vertices, uint64_t* num_faces)
+{
+	const MappedFile file(path);
+	return decode(file.data(), file.size(), path, num_vertices, num_faces);
+}
+
+} // namespace
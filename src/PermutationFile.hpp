@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "TriangleMesh.hpp"
+
+// Binary sidecar with the reordering of a mesh, to apply it again to other
+// meshes with the same connectivity without computing the layout.
+//
+// Layout, little endian:
+//   magic "MLOPERM" and a zero byte, uint32 version, uint32 flags,
+//   uint64 number of vertices, uint64 number of faces,
+//   then the sections present in the flags, each one as uint64 size in bytes and the data:
+//   vertex old2new, face order (uint32 each, or varints of the zigzag deltas
+//   between consecutive entries if compressed) and face rotations (2 bits each).
+namespace PermutationFile {
+
+constexpr uint32_t VERSION = 1;
+
+// Contents of a permutation file
+std::vector<char> encode(const MeshPermutation& permutation,
+	uint64_t num_vertices, uint64_t num_faces, bool compress);
+
+// Reads the contents of a permutation file, with the size of its mesh.
+// Throws if they are not a valid permutation, naming the source in the message.
+MeshPermutation decode(const char* data, size_t size, const char* name,
+	uint64_t* num_vertices, uint64_t* num_faces);
+
+// Writes the permutation of a mesh with the given size. Throws if the file cannot be written.
+void write(const char* path, const MeshPermutation& permutation,
+	uint64_t num_vertices, uint64_t num_faces, bool compress);
+
+// Reads a permutation from a memory mapping of the file, with the size of its mesh.
+// Throws if the file is not a valid permutation.
+MeshPermutation read(const char* path, uint64_t* num_vertices, uint64_t* num_faces);
+
+} // namespace
@@ -0,0 +1,635 @@
+#include "PlyReader.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "MappedFile.hpp"
+
+namespace PlyReader {
+
+// ASCII bodies are split in chunks of this many bytes, moved to the next line start.
+// The chunks do not depend on the number of threads.
+constexpr size_t ASCII_CHUNK_SIZE = 1 << 22;
+
+struct Element {
+	std::string name;
+	uint64_t count = 0;
+	std::vector<Property> properties;
+};
+
+enum class Format { Ascii, BinaryLittleEndian, BinaryBigEndian };
+
+struct Header {
+	Format format = Format::Ascii;
+	std::vector<Element> elements;
+	// Bytes up to the end of the end_header line
+	size_t size = 0;
+};
+
+static Type parse_type(const std::string& name)
+{
+	if (name == "char" || name == "int8") return Type::Int8;
+	if (name == "uchar" || name == "uint8") return Type::Uint8;
+	if (name == "short" || name == "int16") return Type::Int16;
+	if (name == "ushort" || name == "uint16") return Type::Uint16;
+	if (name == "int" || name == "int32") return Type::Int32;
+	if (name == "uint" || name == "uint32") return Type::Uint32;
+	if (name == "float" || name == "float32") return Type::Float32;
+	if (name == "double" || name == "float64") return Type::Float64;
+	return Type::Invalid;
+}
+
+size_t type_size(Type type)
+{
+	switch (type) {
+	case Type::Int8: case Type::Uint8: return 1;
+	case Type::Int16: case Type::Uint16: return 2;
+	case Type::Int32: case Type::Uint32: case Type::Float32: return 4;
+	case Type::Float64: return 8;
+	default: return 0;
+	}
+}
+
+const char* type_name(Type type)
+{
+	switch (type) {
+	case Type::Int8: return "char";
+	case Type::Uint8: return "uchar";
+	case Type::Int16: return "short";
+	case Type::Uint16: return "ushort";
+	case Type::Int32: return "int";
+	case Type::Uint32: return "uint";
+	case Type::Float32: return "float";
+	case Type::Float64: return "double";
+	default: return "invalid";
+	}
+}
+
+static bool is_position(const Property& property)
+{
+	return property.name == "x" || property.name == "y" || property.name == "z";
+}
+
+VertexAttributes attributes_layout(const std::vector<Property>& vertex_properties)
+{
+	VertexAttributes attributes;
+	for (const Property& property : vertex_properties) {
+		if (property.list_type != Type::Invalid) {
+			// Records of a fixed size cannot hold lists
+			std::cerr << "Warning: The vertex list property " << property.name <<
+				" is not supported and is not written to the output" << std::endl;
+		}
+		else if (!is_position(property)) {
+			attributes.properties.push_back(property);
+			attributes.stride += type_size(property.type);
+		}
+	}
+	return attributes;
+}
+
+static Header parse_header(const MappedFile& file)
+{
+	Header header;
+	const char* const end = file.data() + file.size();
+	const char* line = file.data();
+	bool first_line = true;
+	while (line < end) {
+		const char* const line_end = (const char*)std::memchr(line, '\n', end - line);
+		if (!line_end) {
+			break;
+		}
+		std::istringstream tokens(std::string(line, line_end));
+		line = line_end + 1;
+
+		std::string keyword;
+		tokens >> keyword;
+		if (first_line) {
+			if (keyword != "ply") {
+				break;
+			}
+			first_line = false;
+		}
+		else if (keyword == "format") {
+			std::string format;
+			tokens >> format;
+			if (format == "ascii") {
+				header.format = Format::Ascii;
+			}
+			else if (format == "binary_little_endian") {
+				header.format = Format::BinaryLittleEndian;
+			}
+			else if (format == "binary_big_endian") {
+				header.format = Format::BinaryBigEndian;
+			}
+			else {
+				break;
+			}
+		}
+		else if (keyword == "element") {
+			Element element;
+			tokens >> element.name >> element.count;
+			if (!tokens) {
+				break;
+			}
+			header.elements.push_back(element);
+		}
+		else if (keyword == "property") {
+			Property property;
+			std::string type;
+			tokens >> type;
+			if (type == "list") {
+				std::string list_type;
+				tokens >> list_type >> type;
+				property.list_type = parse_type(list_type);
+				if (property.list_type == Type::Invalid) {
+					break;
+				}
+			}
+			property.type = parse_type(type);
+			tokens >> property.name;
+			if (!tokens || property.type == Type::Invalid || header.elements.empty()) {
+				break;
+			}
+			header.elements.back().properties.push_back(property);
+		}
+		else if (keyword == "end_header") {
+			header.size = line - file.data();
+			return header;
+		}
+		// Comments and other lines are ignored
+	}
+	throw std::runtime_error("Error: Can't parse ply header.");
+}
+
+static bool is_face_indices(const Property& property)
+{
+	return property.list_type != Type::Invalid &&
+		(property.name == "vertex_indices" || property.name == "vertex_index");
+}
+
+static int find_property(const Element& element, const char* name)
+{
+	for (size_t i = 0; i < element.properties.size(); ++i) {
+		if (element.properties[i].name == name) {
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+static bool is_little_endian()
+{
+	const uint16_t one = 1;
+	uint8_t first_byte;
+	std::memcpy(&first_byte, &one, 1);
+	return first_byte == 1;
+}
+
+// Value of type at p, converted to T
+template<typename T>
+static inline T read_binary(const char* p, Type type)
+{
+	switch (type) {
+	case Type::Int8: { int8_t v; std::memcpy(&v, p, sizeof(v)); return (T)v; }
+	case Type::Uint8: { uint8_t v; std::memcpy(&v, p, sizeof(v)); return (T)v; }
+	case Type::Int16: { int16_t v; std::memcpy(&v, p, sizeof(v)); return (T)v; }
+	case Type::Uint16: { uint16_t v; std::memcpy(&v, p, sizeof(v)); return (T)v; }
+	case Type::Int32: { int32_t v; std::memcpy(&v, p, sizeof(v)); return (T)v; }
+	case Type::Uint32: { uint32_t v; std::memcpy(&v, p, sizeof(v)); return (T)v; }
+	case Type::Float32: { float v; std::memcpy(&v, p, sizeof(v)); return (T)v; }
+	case Type::Float64: { double v; std::memcpy(&v, p, sizeof(v)); return (T)v; }
+	default: return T();
+	}
+}
+
+static bool read_binary_mesh(
+	const MappedFile& file, const Header& header,
+	const Element& vertex_element, const Element& face_element,
+	std::vector<Eigen::Vector3f>* vertices, VertexAttributes* attributes, std::vector<Eigen::Array3i>* faces)
+{
+	// Every record has the same size if the faces are triangles.
+	// Only the elements up to the vertices and faces are needed.
+	size_t offset = header.size;
+	size_t vertex_begin = 0, vertex_stride = 0;
+	size_t face_begin = 0, face_stride = 0, indices_offset = 0;
+	const Property* indices = nullptr;
+	uint32_t found = 0;
+	for (const Element& element : header.elements) {
+		if (found == 2) {
+			break;
+		}
+		size_t stride = 0;
+		for (const Property& property : element.properties) {
+			if (property.list_type == Type::Invalid) {
+				stride += type_size(property.type);
+			}
+			else if (&element == &face_element && is_face_indices(property) && !indices) {
+				indices = &property;
+				indices_offset = stride;
+				stride += type_size(property.list_type) + 3 * type_size(property.type);
+			}
+			else {
+				return false;
+			}
+		}
+		if (&element == &vertex_element) {
+			vertex_begin = offset;
+			vertex_stride = stride;
+			found += 1;
+		}
+		else if (&element == &face_element) {
+			face_begin = offset;
+			face_stride = stride;
+			found += 1;
+		}
+		offset += element.count * stride;
+	}
+	if (!indices) {
+		throw std::runtime_error("Error: Can't load faces of ply.");
+	}
+	if (offset > file.size()) {
+		throw std::runtime_error("Error: Unexpected end of ply file.");
+	}
+
+	// Positions
+	size_t coordinate_offset[3] = {};
+	Type coordinate_type[3];
+	const char* const coordinate_names[3] = { "x", "y", "z" };
+	for (uint32_t k = 0; k < 3; ++k) {
+		const int p = find_property(vertex_element, coordinate_names[k]);
+		for (int i = 0; i < p; ++i) {
+			coordinate_offset[k] += type_size(vertex_element.properties[i].type);
+		}
+		coordinate_type[k] = vertex_element.properties[p].type;
+	}
+
+	// Byte ranges of the other properties, joining consecutive ones
+	struct CopyRange {
+		size_t source;
+		size_t target;
+		size_t size;
+	};
+	std::vector<CopyRange> attribute_ranges;
+	size_t source = 0, target = 0;
+	for (const Property& property : vertex_element.properties) {
+		const size_t size = type_size(property.type);
+		if (!is_position(property)) {
+			if (!attribute_ranges.empty() && attribute_ranges.back().source + attribute_ranges.back().size == source) {
+				attribute_ranges.back().size += size;
+			}
+			else {
+				attribute_ranges.push_back({ source, target, size });
+			}
+			target += size;
+		}
+		source += size;
+	}
+
+	const int64_t num_vertices = (int64_t)vertex_element.count;
+	const char* const vertex_data = file.data() + vertex_begin;
+	vertices->resize(num_vertices);
+	*attributes = attributes_layout(vertex_element.properties);
+	attributes->data.resize(num_vertices * attributes->stride);
+	uint8_t* const attribute_data = attributes->data.data();
+	const size_t attribute_stride = attributes->stride;
+#pragma omp parallel for schedule(static)
+	for (int64_t i = 0; i < num_vertices; ++i) {
+		const char* const record = vertex_data + i * vertex_stride;
+		Eigen::Vector3f& v = (*vertices)[i];
+		for (uint32_t k = 0; k < 3; ++k) {
+			v[k] = read_binary<float>(record + coordinate_offset[k], coordinate_type[k]);
+		}
+		for (const CopyRange& range : attribute_ranges) {
+			std::memcpy(attribute_data + i * attribute_stride + range.target, record + range.source, range.size);
+		}
+	}
+
+	// Triangles
+	const int64_t num_faces = (int64_t)face_element.count;
+	const char* const face_data = file.data() + face_begin + indices_offset;
+	const size_t length_size = type_size(indices->list_type);
+	const size_t index_size = type_size(indices->type);
+	int64_t not_triangles = 0, out_of_range = 0;
+	faces->resize(num_faces);
+#pragma omp parallel for schedule(static) reduction(+:not_triangles, out_of_range)
+	for (int64_t i = 0; i < num_faces; ++i) {
+		const char* const record = face_data + i * face_stride;
+		if (read_binary<int64_t>(record, indices->list_type) != 3) {
+			not_triangles += 1;
+			continue;
+		}
+		Eigen::Array3i& face = (*faces)[i];
+		for (uint32_t k = 0; k < 3; ++k) {
+			const int64_t index = read_binary<int64_t>(record + length_size + k * index_size, indices->type);
+			out_of_range += (index < 0 || index >= num_vertices);
+			face[k] = (int32_t)index;
+		}
+	}
+	if (not_triangles > 0) {
+		return false;
+	}
+	if (out_of_range > 0) {
+		throw std::runtime_error("Error: Face index out of range in ply.");
+	}
+	return true;
+}
+
+static inline const char* skip_spaces(const char* p, const char* end)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+		++p;
+	}
+	return p;
+}
+
+template<typename T>
+static inline bool parse_number(const char** p, const char* end, T* value)
+{
+	const char* begin = skip_spaces(*p, end);
+	if (begin < end && *begin == '+') {
+		++begin;
+	}
+	const std::from_chars_result result = std::from_chars(begin, end, *value);
+	if (result.ec != std::errc()) {
+		return false;
+	}
+	*p = result.ptr;
+	return true;
+}
+
+static inline bool skip_token(const char** p, const char* end)
+{
+	const char* begin = skip_spaces(*p, end);
+	const char* token_end = begin;
+	while (token_end < end && *token_end != ' ' && *token_end != '\t' && *token_end != '\r') {
+		++token_end;
+	}
+	*p = token_end;
+	return token_end != begin;
+}
+
+static inline bool skip_property(const Property& property, const char** p, const char* end)
+{
+	if (property.list_type == Type::Invalid) {
+		return skip_token(p, end);
+	}
+	int64_t length;
+	if (!parse_number(p, end, &length)) {
+		return false;
+	}
+	for (int64_t i = 0; i < length; ++i) {
+		if (!skip_token(p, end)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Parses the next number of the line, stored as a value of type at out
+static inline bool parse_value(const char** p, const char* end, Type type, uint8_t* out)
+{
+	if (type == Type::Float32) {
+		float v;
+		if (!parse_number(p, end, &v)) {
+			return false;
+		}
+		std::memcpy(out, &v, sizeof(v));
+		return true;
+	}
+	if (type == Type::Float64) {
+		double v;
+		if (!parse_number(p, end, &v)) {
+			return false;
+		}
+		std::memcpy(out, &v, sizeof(v));
+		return true;
+	}
+	int64_t v;
+	if (!parse_number(p, end, &v)) {
+		return false;
+	}
+	switch (type) {
+	case Type::Int8: { const int8_t t = (int8_t)v; std::memcpy(out, &t, sizeof(t)); break; }
+	case Type::Uint8: { const uint8_t t = (uint8_t)v; std::memcpy(out, &t, sizeof(t)); break; }
+	case Type::Int16: { const int16_t t = (int16_t)v; std::memcpy(out, &t, sizeof(t)); break; }
+	case Type::Uint16: { const uint16_t t = (uint16_t)v; std::memcpy(out, &t, sizeof(t)); break; }
+	case Type::Int32: { const int32_t t = (int32_t)v; std::memcpy(out, &t, sizeof(t)); break; }
+	case Type::Uint32: { const uint32_t t = (uint32_t)v; std::memcpy(out, &t, sizeof(t)); break; }
+	default: return false;
+	}
+	return true;
+}
+
+// Where each property of a vertex line goes: a coordinate of the position,
+// an offset in the attribute record, or nowhere
+struct VertexField {
+	int coordinate = -1;
+	int64_t attribute_offset = -1;
+};
+
+static bool parse_vertex_line(const Element& element, const VertexField* fields, const char* p, const char* end, Eigen::Vector3f* v, uint8_t* attributes)
+{
+	for (size_t i = 0; i < element.properties.size(); ++i) {
+		if (fields[i].coordinate >= 0) {
+			if (!parse_number(&p, end, &(*v)[fields[i].coordinate])) {
+				return false;
+			}
+		}
+		else if (fields[i].attribute_offset >= 0) {
+			if (!parse_value(&p, end, element.properties[i].type, attributes + fields[i].attribute_offset)) {
+				return false;
+			}
+		}
+		else if (!skip_property(element.properties[i], &p, end)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool parse_face_line(const Element& element, const char* p, const char* end, Eigen::Array3i* face)
+{
+	for (const Property& property : element.properties) {
+		if (is_face_indices(property)) {
+			int64_t length;
+			if (!parse_number(&p, end, &length) || length != 3) {
+				return false;
+			}
+			for (uint32_t k = 0; k < 3; ++k) {
+				if (!parse_number(&p, end, &(*face)[k])) {
+					return false;
+				}
+			}
+		}
+		else if (!skip_property(property, &p, end)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool read_ascii_mesh(
+	const MappedFile& file, const Header& header,
+	const Element& vertex_element, const Element& face_element,
+	std::vector<Eigen::Vector3f>* vertices, VertexAttributes* attributes, std::vector<Eigen::Array3i>* faces)
+{
+	// One line per record, so the elements are ranges of lines
+	uint64_t vertex_first_line = 0, face_first_line = 0, num_lines = 0;
+	for (const Element& element : header.elements) {
+		if (&element == &vertex_element) {
+			vertex_first_line = num_lines;
+		}
+		if (&element == &face_element) {
+			face_first_line = num_lines;
+		}
+		num_lines += element.count;
+	}
+	const uint64_t lines_needed = std::max(vertex_first_line + vertex_element.count, face_first_line + face_element.count);
+
+	std::vector<VertexField> fields(vertex_element.properties.size());
+	fields[find_property(vertex_element, "x")].coordinate = 0;
+	fields[find_property(vertex_element, "y")].coordinate = 1;
+	fields[find_property(vertex_element, "z")].coordinate = 2;
+	int64_t attribute_offset = 0;
+	for (size_t i = 0; i < fields.size(); ++i) {
+		const Property& property = vertex_element.properties[i];
+		if (property.list_type == Type::Invalid && !is_position(property)) {
+			fields[i].attribute_offset = attribute_offset;
+			attribute_offset += type_size(property.type);
+		}
+	}
+
+	const char* const body = file.data() + header.size;
+	const size_t body_size = file.size() - header.size;
+	const int64_t num_chunks = (int64_t)std::max<size_t>(1, (body_size + ASCII_CHUNK_SIZE - 1) / ASCII_CHUNK_SIZE);
+
+	// Start of the first line of each chunk
+	std::vector<size_t> chunk_begin(num_chunks + 1, body_size);
+#pragma omp parallel for
+	for (int64_t c = 0; c < num_chunks; ++c) {
+		if (c == 0) {
+			chunk_begin[c] = 0;
+			continue;
+		}
+		const size_t from = c * ASCII_CHUNK_SIZE - 1;
+		const char* const newline = (const char*)std::memchr(body + from, '\n', body_size - from);
+		chunk_begin[c] = newline ? (newline - body) + 1 : body_size;
+	}
+
+	// Index of the first line of each chunk
+	std::vector<uint64_t> chunk_first_line(num_chunks + 1, 0);
+#pragma omp parallel for
+	for (int64_t c = 0; c < num_chunks; ++c) {
+		const char* const begin = body + chunk_begin[c];
+		const char* const end = body + chunk_begin[c + 1];
+		uint64_t lines = (uint64_t)std::count(begin, end, '\n');
+		if (end > begin && end[-1] != '\n') {
+			lines += 1;
+		}
+		chunk_first_line[c + 1] = lines;
+	}
+	for (int64_t c = 0; c < num_chunks; ++c) {
+		chunk_first_line[c + 1] += chunk_first_line[c];
+	}
+	if (chunk_first_line[num_chunks] < lines_needed) {
+		throw std::runtime_error("Error: Unexpected end of ply file.");
+	}
+
+	vertices->resize(vertex_element.count);
+	*attributes = attributes_layout(vertex_element.properties);
+	attributes->data.resize(vertex_element.count * attributes->stride);
+	uint8_t* const attribute_data = attributes->data.data();
+	const size_t attribute_stride = attributes->stride;
+	faces->resize(face_element.count);
+	const int64_t num_vertices = (int64_t)vertex_element.count;
+	int64_t failed = 0, out_of_range = 0;
+#pragma omp parallel for schedule(dynamic, 1) reduction(+:failed, out_of_range)
+	for (int64_t c = 0; c < num_chunks; ++c) {
+		const char* p = body + chunk_begin[c];
+		const char* const end = body + chunk_begin[c + 1];
+		for (uint64_t line = chunk_first_line[c]; p < end && line < lines_needed; ++line) {
+			const char* line_end = (const char*)std::memchr(p, '\n', end - p);
+			if (!line_end) {
+				line_end = end;
+			}
+			if (line - vertex_first_line < vertex_element.count) {
+				const uint64_t v = line - vertex_first_line;
+				if (!parse_vertex_line(vertex_element, fields.data(), p, line_end, &(*vertices)[v], attribute_data + v * attribute_stride)) {
+					failed += 1;
+					break;
+				}
+			}
+			else if (line - face_first_line < face_element.count) {
+				Eigen::Array3i& face = (*faces)[line - face_first_line];
+				if (!parse_face_line(face_element, p, line_end, &face)) {
+					failed += 1;
+					break;
+				}
+				for (uint32_t k = 0; k < 3; ++k) {
+					out_of_range += (face[k] < 0 || face[k] >= num_vertices);
+				}
+			}
+			p = line_end + 1;
+		}
+	}
+	// Unusual files, like faces that are not triangles, are left to the generic reader
+	if (failed > 0) {
+		return false;
+	}
+	if (out_of_range > 0) {
+		throw std::runtime_error("Error: Face index out of range in ply.");
+	}
+	return true;
+}
+
+bool read_mesh(
+	const char* path,
+	std::vector<Eigen::Vector3f>* vertices,
+	VertexAttributes* attributes,
+	std::vector<Eigen::Array3i>* faces)
+{
+	const MappedFile file(path);
+	const Header header = parse_header(file);
+
+	const Element* vertex_element = nullptr;
+	const Element* face_element = nullptr;
+	for (const Element& element : header.elements) {
+		if (element.name == "vertex" && !vertex_element) {
+			vertex_element = &element;
+		}
+		else if (element.name == "face" && !face_element) {
+			face_element = &element;
+		}
+	}
+	if (!vertex_element || !face_element ||
+		find_property(*vertex_element, "x") < 0 ||
+		find_property(*vertex_element, "y") < 0 ||
+		find_property(*vertex_element, "z") < 0 ||
+		std::none_of(face_element->properties.begin(), face_element->properties.end(), is_face_indices)) {
+		throw std::runtime_error("Error: Can't load faces of ply.");
+	}
+	if (face_element->count > 0 && vertex_element->count > (uint64_t)std::numeric_limits<int32_t>::max()) {
+		return false;
+	}
+
+	bool res = false;
+	if (header.format == Format::Ascii) {
+		res = read_ascii_mesh(file, header, *vertex_element, *face_element, vertices, attributes, faces);
+	}
+	else if (header.format == Format::BinaryLittleEndian && is_little_endian()) {
+		res = read_binary_mesh(file, header, *vertex_element, *face_element, vertices, attributes, faces);
+	}
+	if (!res) {
+		vertices->clear();
+		*attributes = VertexAttributes();
+		faces->clear();
+	}
+	return res;
+}
+
+} // namespace
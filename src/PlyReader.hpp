@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Fast loader of the vertices and triangles of PLY files.
+// The file is memory mapped and read in place: binary little endian files with
+// a parallel strided copy, ASCII files parsed in parallel by chunks of lines.
+namespace PlyReader {
+
+enum class Type : uint8_t { Invalid, Int8, Uint8, Int16, Uint16, Int32, Uint32, Float32, Float64 };
+
+// Bytes of a value of the type, 0 if invalid
+size_t type_size(Type type);
+
+// Name of the type in a PLY header
+const char* type_name(Type type);
+
+struct Property {
+	std::string name;
+	Type type = Type::Invalid;
+	// Type of the length of a list, Invalid if the property is not a list
+	Type list_type = Type::Invalid;
+};
+
+// Vertex properties other than the position (normals, texture coordinates, colors...),
+// as one record of stride bytes per vertex, with the properties in file order.
+// Lists in the vertices are not kept.
+struct VertexAttributes {
+	std::vector<Property> properties;
+	size_t stride = 0;
+	std::vector<uint8_t> data;
+};
+
+// Properties and stride of the attributes of a vertex element, without data.
+// List properties are left out with a warning.
+VertexAttributes attributes_layout(const std::vector<Property>& vertex_properties);
+
+// Reads the vertex positions, the other vertex properties and the triangles of the file.
+// Returns false if the layout is not supported, so the caller can use a generic reader:
+// big endian files, faces that are not triangles or lists other than the face indices.
+// Throws if the file cannot be read or is malformed.
+bool read_mesh(
+	const char* path,
+	std::vector<Eigen::Vector3f>* vertices,
+	VertexAttributes* attributes,
+	std::vector<Eigen::Array3i>* faces);
+
+} // namespace
@@ -0,0 +1,114 @@
+#include "PlyWriter.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace PlyWriter {
+
+// Records copied to the buffer before each write
+constexpr size_t WRITE_BLOCK_SIZE = 1 << 16;
+
+void write_mesh(
+	const char* path,
+	const std::vector<Eigen::Vector3f>& vertices,
+	const PlyReader::VertexAttributes& attributes,
+	const std::vector<Eigen::Array3<uint8_t>>& colors,
+	const std::vector<Eigen::Array3i>& faces)
+{
+	assert(colors.empty() || colors.size() == vertices.size());
+	assert(attributes.data.size() == vertices.size() * attributes.stride);
+
+	std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+	if (!stream) {
+		throw std::runtime_error("Error: Can't write file " + std::string(path));
+	}
+
+	std::string header =
+		"ply\n"
+		"format binary_little_endian 1.0\n"
+		"element vertex " + std::to_string(vertices.size()) + "\n"
+		"property float x\n"
+		"property float y\n"
+		"property float z\n";
+
+	// Byte ranges of the attributes written, joining consecutive ones
+	struct CopyRange {
+		size_t source;
+		size_t size;
+	};
+	std::vector<CopyRange> ranges;
+	size_t record_size = 3 * sizeof(float);
+	size_t offset = 0;
+	for (const PlyReader::Property& property : attributes.properties) {
+		const size_t size = PlyReader::type_size(property.type);
+		const bool replaced = !colors.empty() &&
+			(property.name == "red" || property.name == "green" || property.name == "blue");
+		if (!replaced) {
+			header += "property " + std::string(PlyReader::type_name(property.type)) + " " + property.name + "\n";
+			if (!ranges.empty() && ranges.back().source + ranges.back().size == offset) {
+				ranges.back().size += size;
+			}
+			else {
+				ranges.push_back({ offset, size });
+			}
+			record_size += size;
+		}
+		offset += size;
+	}
+	if (!colors.empty()) {
+		header +=
+			"property uchar red\n"
+			"property uchar green\n"
+			"property uchar blue\n";
+		record_size += 3;
+	}
+	header +=
+		"element face " + std::to_string(faces.size()) + "\n"
+		"property list uchar int vertex_indices\n"
+		"end_header\n";
+	stream.write(header.data(), header.size());
+
+	// Vertex records
+	const size_t face_record_size = 1 + 3 * sizeof(int32_t);
+	std::vector<char> buffer(WRITE_BLOCK_SIZE * std::max(record_size, face_record_size));
+	for (size_t begin = 0; begin < vertices.size(); begin += WRITE_BLOCK_SIZE) {
+		const size_t end = std::min(vertices.size(), begin + WRITE_BLOCK_SIZE);
+		char* out = buffer.data();
+		for (size_t i = begin; i < end; ++i) {
+			std::memcpy(out, vertices[i].data(), 3 * sizeof(float));
+			out += 3 * sizeof(float);
+			const uint8_t* const record = attributes.data.data() + i * attributes.stride;
+			for (const CopyRange& range : ranges) {
+				std::memcpy(out, record + range.source, range.size);
+				out += range.size;
+			}
+			if (!colors.empty()) {
+				std::memcpy(out, colors[i].data(), 3);
+				out += 3;
+			}
+		}
+		stream.write(buffer.data(), out - buffer.data());
+	}
+
+	// Triangles
+	for (size_t begin = 0; begin < faces.size(); begin += WRITE_BLOCK_SIZE) {
+		const size_t end = std::min(faces.size(), begin + WRITE_BLOCK_SIZE);
+		char* out = buffer.data();
+		for (size_t i = begin; i < end; ++i) {
+			*out = 3;
+			std::memcpy(out + 1, faces[i].data(), 3 * sizeof(int32_t));
+			out += face_record_size;
+		}
+		stream.write(buffer.data(), out - buffer.data());
+	}
+
+	if (!stream) {
+		throw std::runtime_error("Error: Can't write file " + std::string(path));
+	}
+}
+
+} // namespace
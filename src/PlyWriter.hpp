@@ -0,0 +1,21 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <cstdint>
+#include <vector>
+#include "PlyReader.hpp"
+
+// Writer of binary little endian PLY files, with the vertex attributes read by PlyReader
+namespace PlyWriter {
+
+// Writes the positions, the attributes and the triangles.
+// Non empty colors are written as red, green and blue, replacing the attributes of the same names.
+// Throws if the file cannot be written.
+void write_mesh(
+	const char* path,
+	const std::vector<Eigen::Vector3f>& vertices,
+	const PlyReader::VertexAttributes& attributes,
+	const std::vector<Eigen::Array3<uint8_t>>& colors,
+	const std::vector<Eigen::Array3i>& faces);
+
+} // namespace
@@ -0,0 +1,185 @@
+#include "Profiler.hpp"
+
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+namespace Profiler {
+
+struct PhaseStats {
+	double seconds = 0.0;
+	uint64_t calls = 0;
+};
+
+// Times of the phases of one thread, by name pointer, merged in the report.
+// Only the report locks them besides their thread, so timers do not wait on each other.
+struct ThreadPhases {
+	std::mutex mutex;
+	std::unordered_map<const char*, PhaseStats> phases;
+};
+
+struct Registry {
+	std::mutex mutex;
+	// Kept after their threads end
+	std::vector<std::shared_ptr<ThreadPhases>> threads;
+	// Ordered by name, so the reports of two runs are easy to compare
+	std::map<std::string, uint64_t> counters;
+};
+
+static Registry& registry()
+{
+	static Registry instance;
+	return instance;
+}
+
+static ThreadPhases& thread_phases()
+{
+	thread_local std::shared_ptr<ThreadPhases> phases;
+	if (!phases) {
+		phases = std::make_shared<ThreadPhases>();
+		Registry& r = registry();
+		std::lock_guard<std::mutex> lock(r.mutex);
+		r.threads.push_back(phases);
+	}
+	return *phases;
+}
+
+static std::atomic<bool> s_enabled(false);
+
+void set_enabled(bool enabled)
+{
+	s_enabled = enabled;
+}
+
+bool is_enabled()
+{
+	return s_enabled.load(std::memory_order_relaxed);
+}
+
+void add_time(const char* phase, double seconds)
+{
+	if (!is_enabled()) {
+		return;
+	}
+	ThreadPhases& t = thread_phases();
+	std::lock_guard<std::mutex> lock(t.mutex);
+	PhaseStats& stats = t.phases[phase];
+	stats.seconds += seconds;
+	stats.calls += 1;
+}
+
+void add_counter(const char* name, uint64_t value)
+{
+	if (!is_enabled()) {
+		return;
+	}
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	r.counters[name] += value;
+}
+
+uint64_t peak_rss_bytes()
+{
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return 0;
+	}
+	return (uint64_t)counters.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+#if defined(__APPLE__)
+	return (uint64_t)usage.ru_maxrss;
+#else
+	// Kilobytes on Linux
+	return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+static std::string json_string(const std::string& s)
+{
+	std::string result = "\"";
+	for (const char c : s) {
+		switch (c) {
+		case '"': result += "\\\""; break;
+		case '\\': result += "\\\\"; break;
+		case '\n': result += "\\n"; break;
+		case '\t': result += "\\t"; break;
+		default:
+			if ((unsigned char)c < 0x20) {
+				const char* hex = "0123456789abcdef";
+				result += "\\u00";
+				result += hex[(c >> 4) & 0xf];
+				result += hex[c & 0xf];
+			}
+			else {
+				result += c;
+			}
+		}
+	}
+	return result + "\"";
+}
+
+bool write_report(const char* path, const std::vector<std::string>& arguments)
+{
+	std::ofstream stream(path);
+	if (!stream) {
+		return false;
+	}
+
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+
+	std::map<std::string, PhaseStats> phases;
+	for (const std::shared_ptr<ThreadPhases>& t : r.threads) {
+		std::lock_guard<std::mutex> thread_lock(t->mutex);
+		for (const auto& it : t->phases) {
+			PhaseStats& stats = phases[it.first];
+			stats.seconds += it.second.seconds;
+			stats.calls += it.second.calls;
+		}
+	}
+
+	stream << "{\n  \"arguments\": [";
+	for (size_t i = 0; i < arguments.size(); ++i) {
+		stream << (i == 0 ? "" : ", ") << json_string(arguments[i]);
+	}
+	stream << "],\n";
+
+	stream << "  \"peak_rss_bytes\": " << peak_rss_bytes() << ",\n";
+
+	stream << "  \"phases\": {";
+	bool first = true;
+	for (const auto& it : phases) {
+		stream << (first ? "\n" : ",\n") << "    " << json_string(it.first) <<
+			": { \"seconds\": " << it.second.seconds << ", \"calls\": " << it.second.calls << " }";
+		first = false;
+	}
+	stream << "\n  },\n";
+
+	stream << "  \"counters\": {";
+	first = true;
+	for (const auto& it : r.counters) {
+		stream << (first ? "\n" : ",\n") << "    " << json_string(it.first) << ": " << it.second;
+		first = false;
+	}
+	stream << "\n  }\n}\n";
+
+	return (bool)stream;
+}
+
+} // namespace
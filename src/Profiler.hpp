@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Wall time of the phases of a run and counters, reported as JSON.
+// Disabled by default, then timers and counters do nothing.
+// Phases timed inside parallel regions add up the time of all the threads.
+namespace Profiler {
+
+void set_enabled(bool enabled);
+
+bool is_enabled();
+
+// Adds seconds and one call to the phase, in the tables of the calling thread.
+// The name is kept until the report, like the literals of the timers.
+void add_time(const char* phase, double seconds);
+
+void add_counter(const char* name, uint64_t value);
+
+// Largest resident set size of the process so far, 0 if unknown
+uint64_t peak_rss_bytes();
+
+// Writes the phases, counters and peak RSS, with the command line arguments.
+// Returns false if the file cannot be written.
+bool write_report(const char* path, const std::vector<std::string>& arguments);
+
+// Times its scope as one call of the phase. The name must live until the report.
+class ScopedTimer {
+public:
+	explicit ScopedTimer(const char* phase) :
+		m_phase(phase),
+		m_start(std::chrono::steady_clock::now())
+	{}
+
+	~ScopedTimer() {
+		stop();
+	}
+
+	// Ends the phase before the end of the scope
+	void stop() {
+		if (!m_stopped && is_enabled()) {
+			const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - m_start;
+			add_time(m_phase, duration.count());
+		}
+		m_stopped = true;
+	}
+
+	ScopedTimer(const ScopedTimer&) = delete;
+	ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+	const char* m_phase;
+	const std::chrono::steady_clock::time_point m_start;
+	bool m_stopped = false;
+};
+
+} // namespace
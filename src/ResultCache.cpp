@@ -0,0 +1,205 @@
+#include "ResultCache.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include "Hash.hpp"
+#include "MappedFile.hpp"
+#include "PermutationFile.hpp"
+
+namespace fs = std::filesystem;
+
+namespace ResultCache {
+
+static const char MAGIC[8] = { 'M', 'L', 'O', 'C', 'A', 'C', 'H', 'E' };
+constexpr uint32_t VERSION = 1;
+
+// Temporary files this old were left by processes that did not finish
+constexpr std::chrono::hours STALE_TEMPORARY_AGE(1);
+
+static_assert(sizeof(Eigen::Vector3f) == 3 * sizeof(float), "Vertices must be packed to hash them");
+static_assert(sizeof(Eigen::Array3i) == 3 * sizeof(int32_t), "Faces must be packed to hash them");
+
+Key make_key(const TriangleMesh& mesh, const std::string& parameters)
+{
+	const std::vector<Eigen::Vector3f>& vertices = mesh.get_vertices();
+	const std::vector<Eigen::Array3i>& faces = mesh.get_faces();
+
+	Key key;
+	const uint64_t vertices_hash = Hash::parallel_hash(vertices.data(), vertices.size() * sizeof(Eigen::Vector3f));
+	key.mesh_hash = Hash::parallel_hash(faces.data(), faces.size() * sizeof(Eigen::Array3i), vertices_hash);
+	key.parameters = parameters;
+	key.hash = Hash::xxhash64(parameters.data(), parameters.size(), key.mesh_hash);
+	return key;
+}
+
+static std::string to_hex(uint64_t value)
+{
+	char text[17];
+	std::snprintf(text, sizeof(text), "%016llx", (unsigned long long)value);
+	return text;
+}
+
+static fs::path entry_path(const std::string& directory, const Key& key)
+{
+	return fs::path(directory) / (to_hex(key.hash) + ".layout");
+}
+
+template<typename T>
+static void append(const T& value, std::vector<char>* out)
+{
+	const char* const bytes = reinterpret_cast<const char*>(&value);
+	out->insert(out->end(), bytes, bytes + sizeof(value));
+}
+
+bool load(const std::string& directory, const Key& key, const TriangleMesh& mesh, Entry* entry)
+{
+	const fs::path path = entry_path(directory, key);
+	std::error_code error;
+	if (!fs::exists(path, error)) {
+		return false;
+	}
+
+	// Another process may replace or remove the file meanwhile, then it is a miss
+	try {
+		const MappedFile file(path.string().c_str());
+		size_t offset = 0;
+		auto read_bytes = [&](void* out, size_t size) {
+			if (file.size() - offset < size) {
+				return false;
+			}
+			std::memcpy(out, file.data() + offset, size);
+			offset += size;
+			return true;
+		};
+
+		char magic[sizeof(MAGIC)];
+		uint32_t version, parameters_size;
+		if (!read_bytes(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+			!read_bytes(&version, sizeof(version)) || version != VERSION ||
+			!read_bytes(&parameters_size, sizeof(parameters_size))) {
+			return false;
+		}
+		std::string parameters(parameters_size, '\0');
+		uint64_t mesh_hash, num_clusters;
+		if (!read_bytes(&parameters[0], parameters_size) || parameters != key.parameters ||
+			!read_bytes(&mesh_hash, sizeof(mesh_hash)) || mesh_hash != key.mesh_hash ||
+			!read_bytes(&num_clusters, sizeof(num_clusters)) ||
+			(num_clusters != 0 && num_clusters != mesh.get_vertices().size())) {
+			return false;
+		}
+		entry->clusters.resize(num_clusters);
+		if (!read_bytes(entry->clusters.data(), num_clusters * sizeof(uint32_t))) {
+			return false;
+		}
+
+		uint64_t num_vertices, num_faces;
+		entry->permutation = PermutationFile::decode(file.data() + offset, file.size() - offset,
+			path.string().c_str(), &num_vertices, &num_faces);
+		if (num_vertices != mesh.get_vertices().size() || num_faces != mesh.get_faces().size()) {
+			return false;
+		}
+	}
+	catch (const std::exception&) {
+		return false;
+	}
+
+	// Most recently used
+	fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+	return true;
+}
+
+// Removes the least recently used entries until the directory takes at most max_bytes
+static void evict(const fs::path& directory, uint64_t max_bytes)
+{
+	struct CacheFile {
+		fs::path path;
+		fs::file_time_type time;
+		uint64_t size;
+	};
+	std::vector<CacheFile> entries;
+	uint64_t total = 0;
+	const fs::file_time_type now = fs::file_time_type::clock::now();
+
+	std::error_code error;
+	for (fs::directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+		const fs::path& path = it->path();
+		// Files removed by other processes are skipped
+		std::error_code file_error;
+		const fs::file_time_type time = fs::last_write_time(path, file_error);
+		if (file_error) {
+			continue;
+		}
+		if (path.extension() == ".layout") {
+			const uint64_t size = fs::file_size(path, file_error);
+			if (!file_error) {
+				entries.push_back({ path, time, size });
+				total += size;
+			}
+		}
+		else if (path.filename().string().find(".layout.tmp") != std::string::npos && now - time > STALE_TEMPORARY_AGE) {
+			fs::remove(path, file_error);
+		}
+	}
+
+	std::sort(entries.begin(), entries.end(), [](const CacheFile& a, const CacheFile& b) {
+		return a.time < b.time;
+	});
+	for (const CacheFile& entry : entries) {
+		if (total <= max_bytes) {
+			break;
+		}
+		fs::remove(entry.path, error);
+		total -= entry.size;
+	}
+}
+
+bool store(const std::string& directory, const Key& key, const TriangleMesh& mesh, const Entry& entry, uint64_t max_bytes)
+{
+	assert(entry.clusters.empty() || entry.clusters.size() == mesh.get_vertices().size());
+	std::error_code error;
+	fs::create_directories(directory, error);
+
+	std::vector<char> data(MAGIC, MAGIC + sizeof(MAGIC));
+	append(VERSION, &data);
+	append((uint32_t)key.parameters.size(), &data);
+	data.insert(data.end(), key.parameters.begin(), key.parameters.end());
+	append(key.mesh_hash, &data);
+	append((uint64_t)entry.clusters.size(), &data);
+	const char* const clusters = reinterpret_cast<const char*>(entry.clusters.data());
+	data.insert(data.end(), clusters, clusters + entry.clusters.size() * sizeof(uint32_t));
+	const std::vector<char> permutation = PermutationFile::encode(entry.permutation,
+		mesh.get_vertices().size(), mesh.get_faces().size(), false);
+	data.insert(data.end(), permutation.begin(), permutation.end());
+
+	// Written with a unique name in the same directory, then renamed in one step,
+	// so readers never see a partial entry
+	const fs::path path = entry_path(directory, key);
+	std::random_device device;
+	fs::path temporary = path;
+	temporary += ".tmp" + to_hex(((uint64_t)device() << 32) | device());
+	{
+		std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+		stream.write(data.data(), data.size());
+		if (!stream) {
+			stream.close();
+			fs::remove(temporary, error);
+			return false;
+		}
+	}
+	fs::rename(temporary, path, error);
+	if (error) {
+		fs::remove(temporary, error);
+		return false;
+	}
+
+	evict(directory, max_bytes);
+	return true;
+}
+
+} // namespace
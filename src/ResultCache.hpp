@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "TriangleMesh.hpp"
+
+// On-disk cache of layouts, so unchanged meshes are not computed again.
+// The key is a hash of the positions and faces with the parameters of the run.
+// Each entry is one file, written to a temporary file and renamed, so several
+// processes can share a directory. Hits refresh the modification time of the entry,
+// and the least recently used entries are removed when the directory grows too large.
+namespace ResultCache {
+
+struct Key {
+	uint64_t hash = 0;
+	uint64_t mesh_hash = 0;
+	// Everything else that changes the result
+	std::string parameters;
+};
+
+struct Entry {
+	// Cluster of each vertex of the input, empty if the mode does not cluster
+	std::vector<uint32_t> clusters;
+	MeshPermutation permutation;
+};
+
+Key make_key(const TriangleMesh& mesh, const std::string& parameters);
+
+// Returns false if the entry is missing or invalid
+bool load(const std::string& directory, const Key& key, const TriangleMesh& mesh, Entry* entry);
+
+// Stores the entry, then evicts entries until the directory takes at most max_bytes.
+// Returns false if it cannot be written.
+bool store(const std::string& directory, const Key& key, const TriangleMesh& mesh, const Entry& entry, uint64_t max_bytes);
+
+} // namespace
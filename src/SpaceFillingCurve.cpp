@@ -0,0 +1,233 @@
+#include "SpaceFillingCurve.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include "Profiler.hpp"
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+namespace SpaceFillingCurve {
+
+// Each block of the radix sort gets at least this many keys, and there are at most this many blocks
+constexpr int64_t RADIX_MIN_BLOCK_SIZE = 1 << 16;
+constexpr int64_t RADIX_MAX_BLOCKS = 64;
+constexpr uint32_t RADIX_BITS = 8;
+constexpr uint32_t RADIX_BUCKETS = 1 << RADIX_BITS;
+
+void radix_sort(std::vector<uint64_t>* keys, std::vector<uint32_t>* values)
+{
+	Profiler::ScopedTimer timer("curve/radix_sort");
+	assert(keys->size() == values->size());
+	const int64_t n = (int64_t)keys->size();
+	if (n < 2) {
+		return;
+	}
+
+	// Bits that change between keys
+	const uint64_t first = (*keys)[0];
+	uint64_t varying = 0;
+#pragma omp parallel for reduction(|:varying)
+	for (int64_t i = 0; i < n; ++i) {
+		varying |= (*keys)[i] ^ first;
+	}
+
+	// The blocks only depend on the number of keys, not on the number of threads
+	const int64_t num_blocks = std::max<int64_t>(1, std::min<int64_t>(RADIX_MAX_BLOCKS, n / RADIX_MIN_BLOCK_SIZE));
+	const int64_t block_size = (n + num_blocks - 1) / num_blocks;
+
+	std::vector<uint64_t> tmp_keys(n);
+	std::vector<uint32_t> tmp_values(n);
+	// Digit major, so the prefix sum keeps the blocks in order within a digit
+	std::vector<int64_t> offsets(RADIX_BUCKETS * num_blocks);
+
+	for (uint32_t shift = 0; shift < 64; shift += RADIX_BITS) {
+		if (((varying >> shift) & (RADIX_BUCKETS - 1)) == 0) {
+			continue;
+		}
+
+		const uint64_t* src_keys = keys->data();
+		const uint32_t* src_values = values->data();
+		std::fill(offsets.begin(), offsets.end(), 0);
+
+#pragma omp parallel for
+		for (int64_t b = 0; b < num_blocks; ++b) {
+			const int64_t end = std::min(n, (b + 1) * block_size);
+			for (int64_t i = b * block_size; i < end; ++i) {
+				offsets[((src_keys[i] >> shift) & (RADIX_BUCKETS - 1)) * num_blocks + b] += 1;
+			}
+		}
+
+		int64_t sum = 0;
+		for (int64_t& o : offsets) {
+			const int64_t count = o;
+			o = sum;
+			sum += count;
+		}
+
+#pragma omp parallel for
+		for (int64_t b = 0; b < num_blocks; ++b) {
+			const int64_t end = std::min(n, (b + 1) * block_size);
+			for (int64_t i = b * block_size; i < end; ++i) {
+				const int64_t pos = offsets[((src_keys[i] >> shift) & (RADIX_BUCKETS - 1)) * num_blocks + b]++;
+				tmp_keys[pos] = src_keys[i];
+				tmp_values[pos] = src_values[i];
+			}
+		}
+
+		keys->swap(tmp_keys);
+		values->swap(tmp_values);
+	}
+}
+
+// Spread the lower 21 bits of x, leaving two zeros between them
+static inline uint64_t part_1_by_2(uint64_t x)
+{
+	x &= 0x1fffff;
+	x = (x | x << 32) & 0x1f00000000ffffULL;
+	x = (x | x << 16) & 0x1f0000ff0000ffULL;
+	x = (x | x << 8) & 0x100f00f00f00f00fULL;
+	x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+	x = (x | x << 2) & 0x1249249249249249ULL;
+	return x;
+}
+
+// Interleave with x in the lowest bit of each triplet
+static inline uint64_t interleave_3(uint32_t x, uint32_t y, uint32_t z)
+{
+#ifdef __BMI2__
+	return _pdep_u64(x, 0x1249249249249249ULL) |
+		_pdep_u64(y, 0x2492492492492492ULL) |
+		_pdep_u64(z, 0x4924924924924924ULL);
+#else
+	return part_1_by_2(x) | (part_1_by_2(y) << 1) | (part_1_by_2(z) << 2);
+#endif
+}
+
+// Integer coordinates in [0, 2^BITS_PER_AXIS) of each vertex, in a cube around the bounding box
+static std::vector<std::array<uint32_t, 3>> quantize_vertices(const TriangleMesh& mesh)
+{
+	const std::vector<Eigen::Vector3f>& vertices = mesh.get_vertices();
+	const uint32_t max_coord = (1u << BITS_PER_AXIS) - 1;
+
+	Eigen::Vector3f min_bbox, max_bbox;
+	mesh.get_bounding_box(&min_bbox, &max_bbox);
+	const float size = (max_bbox - min_bbox).maxCoeff();
+	const float scale = size > 0.0f ? (float)max_coord / size : 0.0f;
+
+	std::vector<std::array<uint32_t, 3>> coords(vertices.size());
+#pragma omp parallel for
+	for (int64_t v = 0; v < (int64_t)vertices.size(); ++v) {
+		for (uint32_t j = 0; j < 3; ++j) {
+			const float q = (vertices[v][j] - min_bbox[j]) * scale;
+			coords[v][j] = std::min(max_coord, (uint32_t)std::max(0.0f, q));
+		}
+	}
+
+	return coords;
+}
+
+std::vector<uint64_t> morton_keys(const TriangleMesh& mesh)
+{
+	Profiler::ScopedTimer timer("curve/morton_keys");
+	const std::vector<std::array<uint32_t, 3>> coords = quantize_vertices(mesh);
+	const int64_t n = (int64_t)coords.size();
+
+	std::vector<uint64_t> keys(n);
+#ifdef __BMI2__
+#pragma omp parallel for
+#else
+	// The magic number version vectorizes over the vertices
+#pragma omp parallel for simd
+#endif
+	for (int64_t v = 0; v < n; ++v) {
+		keys[v] = interleave_3(coords[v][0], coords[v][1], coords[v][2]);
+	}
+
+	return keys;
+}
+
+// Skilling's AxesToTranspose. After it, the Hilbert index is the interleave of
+// the bits of X, with X[0] the most significant of each triplet.
+static inline void axes_to_transpose(uint32_t X[3])
+{
+	const uint32_t M = 1u << (BITS_PER_AXIS - 1);
+
+	// Inverse undo
+	for (uint32_t Q = M; Q > 1; Q >>= 1) {
+		const uint32_t P = Q - 1;
+		for (uint32_t i = 0; i < 3; ++i) {
+			if (X[i] & Q) {
+				X[0] ^= P;
+			}
+			else {
+				const uint32_t t = (X[0] ^ X[i]) & P;
+				X[0] ^= t;
+				X[i] ^= t;
+			}
+		}
+	}
+
+	// Gray encode
+	X[1] ^= X[0];
+	X[2] ^= X[1];
+	uint32_t t = 0;
+	for (uint32_t Q = M; Q > 1; Q >>= 1) {
+		if (X[2] & Q) {
+			t ^= Q - 1;
+		}
+	}
+	for (uint32_t i = 0; i < 3; ++i) {
+		X[i] ^= t;
+	}
+}
+
+std::vector<uint64_t> hilbert_keys(const TriangleMesh& mesh)
+{
+	Profiler::ScopedTimer timer("curve/hilbert_keys");
+	const std::vector<std::array<uint32_t, 3>> coords = quantize_vertices(mesh);
+	const int64_t n = (int64_t)coords.size();
+
+	std::vector<uint64_t> keys(n);
+#pragma omp parallel for
+	for (int64_t v = 0; v < n; ++v) {
+		uint32_t X[3] = { coords[v][0], coords[v][1], coords[v][2] };
+		axes_to_transpose(X);
+		keys[v] = interleave_3(X[2], X[1], X[0]);
+	}
+
+	return keys;
+}
+
+static std::vector<uint32_t> order_by_keys(std::vector<uint64_t> keys)
+{
+	const uint32_t n = (uint32_t)keys.size();
+	std::vector<uint32_t> new2old(n);
+	for (uint32_t v = 0; v < n; ++v) {
+		new2old[v] = v;
+	}
+
+	radix_sort(&keys, &new2old);
+	assert(std::is_sorted(keys.begin(), keys.end()));
+
+	std::vector<uint32_t> old2new(n);
+#pragma omp parallel for
+	for (int64_t i = 0; i < (int64_t)n; ++i) {
+		old2new[new2old[i]] = (uint32_t)i;
+	}
+
+	return old2new;
+}
+
+std::vector<uint32_t> morton_order(const TriangleMesh& mesh)
+{
+	return order_by_keys(morton_keys(mesh));
+}
+
+std::vector<uint32_t> hilbert_order(const TriangleMesh& mesh)
+{
+	return order_by_keys(hilbert_keys(mesh));
+}
+
+} // namespace
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "TriangleMesh.hpp"
+
+// Vertex layouts that follow a space-filling curve through the bounding box of the mesh.
+// They do not look at the connectivity, so they run in near-linear time and serve as
+// a baseline for the spectral layouts.
+namespace SpaceFillingCurve {
+
+// Bits per axis of the quantized coordinates. Three axes fit in a 64 bit key.
+constexpr uint32_t BITS_PER_AXIS = 21;
+
+// Stable sort of keys, moving values along. Parallel LSD radix sort with 8 bit digits.
+// Digits equal in all keys are skipped.
+void radix_sort(std::vector<uint64_t>* keys, std::vector<uint32_t>* values);
+
+// Morton (Z-order) key of each vertex
+std::vector<uint64_t> morton_keys(const TriangleMesh& mesh);
+
+// Hilbert key of each vertex (Skilling 2004)
+std::vector<uint64_t> hilbert_keys(const TriangleMesh& mesh);
+
+// New position of each vertex sorting by its Morton key
+std::vector<uint32_t> morton_order(const TriangleMesh& mesh);
+
+// New position of each vertex sorting by its Hilbert key
+std::vector<uint32_t> hilbert_order(const TriangleMesh& mesh);
+
+} // namespace
@@ -0,0 +1,499 @@
+#include "Spectral.hpp"
+
+#include <Spectra/SymEigsSolver.h>
+#include <Eigen/Eigenvalues>
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <random>
+
+namespace Spectral {
+
+// Products on graphs with fewer rows run on the calling thread
+constexpr int64_t PARALLEL_PRODUCT_MIN_SIZE = 50000;
+constexpr int64_t PARALLEL_PRODUCT_GRAIN = 8192;
+
+// Eigenvalues below this fraction of the largest one are taken as 0
+constexpr float DENSE_ZERO_EIGENVALUE = 1.0e-6f;
+
+// LOBPCG: tightest relative residual reachable in single precision, and
+// relative norm under which a column of the basis is taken as dependent
+constexpr float LOBPCG_MIN_ERROR = 1.0e-5f;
+constexpr float LOBPCG_DEPENDENT_COLUMN = 1.0e-3f;
+
+Eigen::SparseMatrix<float> laplacian_matrix(const WeightedGraph& graph)
+{
+	const uint32_t n = graph.get_num_vertices();
+
+	std::vector< Eigen::Triplet<float>> triplet_list;
+	triplet_list.reserve(graph.neighbors.size() + n);
+	for (uint32_t v = 0; v < n; ++v) {
+		float degree = 0.0f;
+		for (uint32_t i = graph.offsets[v]; i < graph.offsets[v + 1]; ++i) {
+			degree += graph.weight(i);
+			triplet_list.push_back(Eigen::Triplet<float>(v, graph.neighbors[i], -graph.weight(i)));
+		}
+		triplet_list.push_back(Eigen::Triplet<float>(v, v, degree));
+	}
+
+	// Square sparse matrix
+	Eigen::SparseMatrix<float> laplacian(n, n);
+	laplacian.setFromTriplets(triplet_list.begin(), triplet_list.end());
+	laplacian.makeCompressed();
+
+	return laplacian;
+}
+
+LaplacianOp::LaplacianOp(const WeightedGraph& graph) :
+	m_graph(graph)
+{
+	m_degree.resize(graph.get_num_vertices());
+	for (uint32_t v = 0; v < graph.get_num_vertices(); ++v) {
+		m_degree[v] = graph.weighted_degree(v);
+	}
+}
+
+void LaplacianOp::perform_op(const float* x_in, float* y_out) const
+{
+	const int64_t n = (int64_t)m_degree.size();
+	const uint32_t* offsets = m_graph.offsets.data();
+	const uint32_t* neighbors = m_graph.neighbors.data();
+	const float* weights = m_graph.weights.data();
+	const bool unit_weights = m_graph.weights.empty();
+
+	// Tasks, so the product also runs in parallel inside the bisection tasks
+#pragma omp taskloop grainsize(PARALLEL_PRODUCT_GRAIN) if(n >= PARALLEL_PRODUCT_MIN_SIZE)
+	for (int64_t v = 0; v < n; ++v) {
+		const uint32_t begin = offsets[v];
+		const uint32_t end = offsets[v + 1];
+		float acc = 0.0f;
+		if (unit_weights) {
+#pragma omp simd reduction(+:acc)
+			for (uint32_t i = begin; i < end; ++i) {
+				acc += x_in[neighbors[i]];
+			}
+		}
+		else {
+#pragma omp simd reduction(+:acc)
+			for (uint32_t i = begin; i < end; ++i) {
+				acc += weights[i] * x_in[neighbors[i]];
+			}
+		}
+		y_out[v] = m_degree[v] * x_in[v] - acc;
+	}
+}
+
+bool spectral_embedding_lanczos(
+	const WeightedGraph& graph,
+	const uint32_t num_vectors,
+	const uint32_t max_iterations,
+	const float error,
+	const Eigen::VectorXf* initial_guess,
+	Eigen::MatrixXf* embedding,
+	SolveStats* stats)
+{
+	LaplacianOp op(graph);
+	// The constant vector comes along with the requested ones
+	const Eigen::Index nev = num_vectors + 1;
+	const Eigen::Index ncv = std::min<Eigen::Index>(op.rows(), std::max<Eigen::Index>(2 * nev, 4));
+	Spectra::SymEigsSolver<LaplacianOp> eigs(op, nev, ncv);
+	if (initial_guess != nullptr) {
+		eigs.init(initial_guess->data());
+	}
+	else {
+		eigs.init();
+	}
+
+	Eigen::Index num_values = eigs.compute(Spectra::SortRule::SmallestAlge,
+		max_iterations, error,
+		Spectra::SortRule::LargestAlge);
+
+	stats->num_iterations += eigs.num_iterations();
+	stats->num_operations += eigs.num_operations();
+
+	if (num_values != nev) {
+		std::cerr << "Error: num eigenvalues computed is " << num_values << std::endl;
+		return false;
+	}
+	// Get results
+	if (eigs.info() != Spectra::CompInfo::Successful) {
+		std::cout << "Error: No eigenvalues. Computation not successful!" << std::endl;
+		return false;
+	}
+
+	// Sorted by decreasing eigenvalue, the last one is the constant vector
+	float eigenvalue = eigs.eigenvalues()[nev - 2];
+	if (eigenvalue <= 0) {
+		std::cerr << "Error: Fiedler eigenvalue is less than 0. Not a connected graph!!" << std::endl;
+		std::cerr << "Computed eigenvalues " << eigenvalue << std::endl;
+
+		return false;
+	}
+
+	const Eigen::MatrixXf eigenvectors = eigs.eigenvectors();
+	embedding->resize(op.rows(), num_vectors);
+	for (uint32_t j = 0; j < num_vectors; ++j) {
+		embedding->col(j) = eigenvectors.col(nev - 2 - j);
+	}
+
+	return true;
+}
+
+bool spectral_embedding_dense(
+	const WeightedGraph& graph,
+	const uint32_t num_vectors,
+	Eigen::MatrixXf* embedding,
+	SolveStats* stats)
+{
+	const Eigen::MatrixXf laplacian(laplacian_matrix(graph));
+	Eigen::SelfAdjointEigenSolver<Eigen::MatrixXf> es(laplacian);
+
+	stats->num_iterations += 1;
+
+	if (es.info() != Eigen::Success) {
+		std::cerr << "Error: Dense eigen decomposition not successful!" << std::endl;
+		return false;
+	}
+
+	// Increasing eigenvalues, the first one is the constant vector
+	const Eigen::VectorXf& eigenvalues = es.eigenvalues();
+	if (eigenvalues[1] <= DENSE_ZERO_EIGENVALUE * eigenvalues[eigenvalues.size() - 1]) {
+		std::cerr << "Error: Fiedler eigenvalue is 0. Not a connected graph!!" << std::endl;
+		std::cerr << "Computed eigenvalues " << eigenvalues[1] << std::endl;
+
+		return false;
+	}
+
+	*embedding = es.eigenvectors().middleCols(1, num_vectors);
+
+	return true;
+}
+
+// Modified Gram-Schmidt, twice, applying the same operations to the columns
+// of AS so that it stays the product of the Laplacian and S.
+// Columns that are nearly dependent on the previous ones are removed.
+static void orthonormalize(Eigen::MatrixXf* S, Eigen::MatrixXf* AS)
+{
+	Eigen::Index kept = 0;
+	for (Eigen::Index c = 0; c < S->cols(); ++c) {
+		const float initial_norm = S->col(c).norm();
+		for (uint32_t pass = 0; pass < 2; ++pass) {
+			for (Eigen::Index k = 0; k < kept; ++k) {
+				const float projection = S->col(k).dot(S->col(c));
+				S->col(c) -= projection * S->col(k);
+				AS->col(c) -= projection * AS->col(k);
+			}
+		}
+		const float norm = S->col(c).norm();
+		if (!(norm > LOBPCG_DEPENDENT_COLUMN * initial_norm)) {
+			continue;
+		}
+		S->col(kept) = S->col(c) / norm;
+		AS->col(kept) = AS->col(c) / norm;
+		kept += 1;
+	}
+	S->conservativeResize(Eigen::NoChange, kept);
+	AS->conservativeResize(Eigen::NoChange, kept);
+}
+
+bool spectral_embedding_lobpcg(
+	const WeightedGraph& graph,
+	const uint32_t num_vectors,
+	const uint32_t max_iterations,
+	const float error,
+	const Eigen::VectorXf* initial_guess,
+	Eigen::MatrixXf* embedding,
+	SolveStats* stats)
+{
+	const uint32_t n = graph.get_num_vertices();
+	const Eigen::Index m = num_vectors;
+	const LaplacianOp op(graph);
+
+	Eigen::VectorXf inv_degree(n);
+	float max_degree = 0.0f;
+	for (uint32_t v = 0; v < n; ++v) {
+		const float degree = graph.weighted_degree(v);
+		inv_degree[v] = degree > 0.0f ? 1.0f / degree : 0.0f;
+		max_degree = std::max(max_degree, degree);
+	}
+	// Gershgorin bound of the largest eigenvalue
+	const float tolerance = std::max(error, LOBPCG_MIN_ERROR) * 2.0f * max_degree;
+
+	auto apply = [&](const Eigen::MatrixXf& x, Eigen::MatrixXf* y) {
+		y->resize(n, x.cols());
+		for (Eigen::Index c = 0; c < x.cols(); ++c) {
+			op.perform_op(x.col(c).data(), y->col(c).data());
+		}
+		stats->num_operations += x.cols();
+	};
+	// Remove the constant component
+	auto deflate = [](Eigen::MatrixXf* x) {
+		x->rowwise() -= x->colwise().mean();
+	};
+
+	// Deterministic random start, with the guess as first column
+	Eigen::MatrixXf X(n, m);
+	std::minstd_rand rng(1);
+	std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+	for (Eigen::Index c = 0; c < m; ++c) {
+		for (uint32_t i = 0; i < n; ++i) {
+			X(i, c) = distribution(rng);
+		}
+	}
+	if (initial_guess != nullptr) {
+		X.col(0) = *initial_guess;
+	}
+	deflate(&X);
+
+	Eigen::MatrixXf AX, W, AW, P, AP, S, AS;
+	Eigen::VectorXf theta;
+	bool converged = false;
+	apply(X, &AX);
+	orthonormalize(&X, &AX);
+	if (X.cols() != m) {
+		std::cerr << "Error: LOBPCG initial block is rank deficient" << std::endl;
+		return false;
+	}
+
+	for (uint32_t it = 0; it <= max_iterations; ++it) {
+		// Rayleigh-Ritz on the span of [X, W, P]
+		if (it == 0) {
+			S = X;
+			AS = AX;
+		}
+		else {
+			S.resize(n, m + W.cols() + P.cols());
+			AS.resize(n, S.cols());
+			S.leftCols(m) = X;
+			AS.leftCols(m) = AX;
+			S.middleCols(m, W.cols()) = W;
+			AS.middleCols(m, W.cols()) = AW;
+			S.rightCols(P.cols()) = P;
+			AS.rightCols(P.cols()) = AP;
+			orthonormalize(&S, &AS);
+		}
+		Eigen::MatrixXd G = (S.transpose() * AS).cast<double>();
+		G = 0.5 * (G + G.transpose());
+		Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(G);
+		const Eigen::MatrixXf C = es.eigenvectors().leftCols(m).cast<float>();
+		theta = es.eigenvalues().head(m).cast<float>();
+
+		// The first m columns of S are the current X
+		const Eigen::Index num_rest = S.cols() - m;
+		if (num_rest > 0) {
+			P = S.rightCols(num_rest) * C.bottomRows(num_rest);
+			AP = AS.rightCols(num_rest) * C.bottomRows(num_rest);
+		}
+		X = S * C;
+		AX = AS * C;
+
+		const Eigen::MatrixXf R = AX - X * theta.asDiagonal();
+		converged = true;
+		for (Eigen::Index c = 0; c < m; ++c) {
+			converged = converged && R.col(c).norm() <= tolerance;
+		}
+		if (converged || it == max_iterations) {
+			break;
+		}
+		stats->num_iterations += 1;
+
+		// Preconditioned residuals
+		W = inv_degree.asDiagonal() * R;
+		deflate(&W);
+		apply(W, &AW);
+	}
+
+	if (!converged) {
+		std::cerr << "Error: LOBPCG did not converge in " << max_iterations << " iterations" << std::endl;
+		return false;
+	}
+
+	if (theta[0] <= 0.0f) {
+		std::cerr << "Error: Fiedler eigenvalue is less than 0. Not a connected graph!!" << std::endl;
+		std::cerr << "Computed eigenvalues " << theta[0] << std::endl;
+
+		return false;
+	}
+
+	*embedding = std::move(X);
+
+	return true;
+}
+
+bool fiedler_vector_lanczos(
+	const WeightedGraph& graph,
+	const uint32_t max_iterations,
+	const float error,
+	const Eigen::VectorXf* initial_guess,
+	Eigen::VectorXf* fiedler,
+	SolveStats* stats)
+{
+	Eigen::MatrixXf embedding;
+	if (!spectral_embedding_lanczos(graph, 1, max_iterations, error, initial_guess, &embedding, stats)) {
+		return false;
+	}
+	*fiedler = embedding.col(0);
+
+	return true;
+}
+
+// Heavy-edge matching. Each vertex is collapsed with the unmatched neighbor
+// joined by the heaviest edge. Returns the number of coarse vertices.
+static uint32_t coarsen_graph(
+	const WeightedGraph& fine,
+	std::vector<uint32_t>* fine2coarse,
+	WeightedGraph* coarse)
+{
+	const uint32_t unmatched = std::numeric_limits<uint32_t>::max();
+	const uint32_t n = fine.get_num_vertices();
+
+	std::vector<uint32_t> match(n, unmatched);
+	std::vector<uint32_t> coarse2fine;
+	coarse2fine.reserve(n / 2 + 1);
+	fine2coarse->resize(n);
+
+	for (uint32_t v = 0; v < n; ++v) {
+		if (match[v] != unmatched) {
+			continue;
+		}
+		uint32_t best = v;
+		float best_weight = -1.0f;
+		for (uint32_t i = fine.offsets[v]; i < fine.offsets[v + 1]; ++i) {
+			const uint32_t u = fine.neighbors[i];
+			if (match[u] == unmatched && u != v && fine.weight(i) > best_weight) {
+				best = u;
+				best_weight = fine.weight(i);
+			}
+		}
+		match[v] = best;
+		match[best] = v;
+		(*fine2coarse)[v] = (*fine2coarse)[best] = (uint32_t)coarse2fine.size();
+		coarse2fine.push_back(v);
+	}
+
+	const uint32_t num_coarse = (uint32_t)coarse2fine.size();
+
+	// Merge the edges of both matched vertices
+	std::vector<uint32_t> position(num_coarse, unmatched);
+	coarse->offsets.assign(1, 0);
+	coarse->offsets.reserve(num_coarse + 1);
+	coarse->neighbors.clear();
+	coarse->weights.clear();
+	for (uint32_t c = 0; c < num_coarse; ++c) {
+		const uint32_t row_begin = (uint32_t)coarse->neighbors.size();
+		const uint32_t v0 = coarse2fine[c];
+		const uint32_t members[2] = { v0, match[v0] };
+		for (uint32_t m = 0; m < (members[1] == v0 ? 1u : 2u); ++m) {
+			const uint32_t v = members[m];
+			for (uint32_t i = fine.offsets[v]; i < fine.offsets[v + 1]; ++i) {
+				const uint32_t cu = (*fine2coarse)[fine.neighbors[i]];
+				if (cu == c) {
+					continue;
+				}
+				if (position[cu] != unmatched && position[cu] >= row_begin) {
+					coarse->weights[position[cu]] += fine.weight(i);
+				}
+				else {
+					position[cu] = (uint32_t)coarse->neighbors.size();
+					coarse->neighbors.push_back(cu);
+					coarse->weights.push_back(fine.weight(i));
+				}
+			}
+		}
+		coarse->offsets.push_back((uint32_t)coarse->neighbors.size());
+	}
+
+	return num_coarse;
+}
+
+float smooth_fiedler_vector(
+	const WeightedGraph& graph,
+	const uint32_t steps,
+	Eigen::VectorXf* x,
+	SolveStats* stats)
+{
+	// Jacobi damping
+	const float omega = 2.0f / 3.0f;
+	const uint32_t n = graph.get_num_vertices();
+	const LaplacianOp op(graph);
+
+	Eigen::VectorXf degree(n);
+	for (uint32_t v = 0; v < n; ++v) {
+		degree[v] = graph.weighted_degree(v);
+	}
+
+	Eigen::VectorXf y(n);
+	float rho = 0.0f;
+	for (uint32_t s = 0; s < steps; ++s) {
+		x->array() -= x->mean();
+		x->normalize();
+
+		op.perform_op(x->data(), y.data());
+		stats->num_operations += 1;
+
+		rho = x->dot(y);
+		for (uint32_t v = 0; v < n; ++v) {
+			if (degree[v] > 0.0f) {
+				(*x)[v] -= omega * (y[v] - rho * (*x)[v]) / degree[v];
+			}
+		}
+	}
+
+	x->array() -= x->mean();
+	x->normalize();
+
+	return rho;
+}
+
+bool fiedler_vector_multilevel(
+	const WeightedGraph& graph,
+	const uint32_t max_iterations,
+	const float error,
+	const uint32_t coarsest_size,
+	const uint32_t smoothing_steps,
+	Eigen::VectorXf* fiedler,
+	SolveStats* stats)
+{
+	// Stop coarsening if a level does not shrink enough
+	const float min_reduction = 0.9f;
+
+	std::vector<WeightedGraph> levels;
+	std::vector<std::vector<uint32_t>> fine2coarse;
+
+	const WeightedGraph* current = &graph;
+	while (current->get_num_vertices() > coarsest_size) {
+		WeightedGraph coarse;
+		std::vector<uint32_t> mapping;
+		const uint32_t num_coarse = coarsen_graph(*current, &mapping, &coarse);
+		if ((float)num_coarse > min_reduction * (float)current->get_num_vertices()) {
+			break;
+		}
+		levels.push_back(std::move(coarse));
+		fine2coarse.push_back(std::move(mapping));
+		current = &levels.back();
+	}
+
+	Eigen::VectorXf x;
+	if (!fiedler_vector_lanczos(*current, max_iterations, error, nullptr, &x, stats)) {
+		return false;
+	}
+
+	// Project to the finer levels and refine
+	for (int32_t l = (int32_t)levels.size() - 1; l >= 0; --l) {
+		const WeightedGraph& fine = l == 0 ? graph : levels[l - 1];
+		const std::vector<uint32_t>& mapping = fine2coarse[l];
+
+		Eigen::VectorXf x_fine(fine.get_num_vertices());
+		for (uint32_t v = 0; v < fine.get_num_vertices(); ++v) {
+			x_fine[v] = x[mapping[v]];
+		}
+		smooth_fiedler_vector(fine, smoothing_steps, &x_fine, stats);
+		x = std::move(x_fine);
+	}
+
+	*fiedler = std::move(x);
+
+	return true;
+}
+
+} // namespace
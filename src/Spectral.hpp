@@ -0,0 +1,105 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <Eigen/SparseCore>
+#include <cstdint>
+#include "MeshGraph.hpp"
+
+namespace Spectral {
+
+struct SolveStats {
+	uint64_t num_iterations = 0;
+	uint64_t num_operations = 0;
+};
+
+// Weighted Laplacian D - A of the graph
+Eigen::SparseMatrix<float> laplacian_matrix(const WeightedGraph& graph);
+
+// Matrix-free product with the Laplacian D - A, computed from the CSR rows.
+// Follows the operator interface of the Spectra solvers.
+class LaplacianOp {
+public:
+	using Scalar = float;
+
+	LaplacianOp(const WeightedGraph& graph);
+
+	Eigen::Index rows() const { return (Eigen::Index)m_degree.size(); }
+	Eigen::Index cols() const { return (Eigen::Index)m_degree.size(); }
+
+	// y_out = (D - A) * x_in
+	void perform_op(const float* x_in, float* y_out) const;
+
+private:
+	const WeightedGraph& m_graph;
+	std::vector<float> m_degree;
+};
+
+// Eigenvectors of the num_vectors smallest nonzero eigenvalues of the Laplacian,
+// as the columns of embedding by increasing eigenvalue, computed together with
+// Lanczos iterations. The first column is the Fiedler vector.
+// initial_guess can be null to start from a random vector.
+// Returns false if the computation failed.
+bool spectral_embedding_lanczos(
+	const WeightedGraph& graph,
+	const uint32_t num_vectors,
+	const uint32_t max_iterations,
+	const float error,
+	const Eigen::VectorXf* initial_guess,
+	Eigen::MatrixXf* embedding,
+	SolveStats* stats);
+
+// Same as spectral_embedding_lanczos, with a dense eigen decomposition of the
+// assembled Laplacian. Cubic in the number of vertices, for small graphs.
+bool spectral_embedding_dense(
+	const WeightedGraph& graph,
+	const uint32_t num_vectors,
+	Eigen::MatrixXf* embedding,
+	SolveStats* stats);
+
+// Same as spectral_embedding_lanczos, with block LOBPCG (Knyazev 2001) and a
+// Jacobi preconditioner, on the space orthogonal to the constant vector.
+// The tolerance is on the residual norms, relative to the norm of the Laplacian.
+// Returns false if it does not converge in max_iterations.
+bool spectral_embedding_lobpcg(
+	const WeightedGraph& graph,
+	const uint32_t num_vectors,
+	const uint32_t max_iterations,
+	const float error,
+	const Eigen::VectorXf* initial_guess,
+	Eigen::MatrixXf* embedding,
+	SolveStats* stats);
+
+// Fiedler vector with Lanczos iterations, as spectral_embedding_lanczos with one vector.
+// initial_guess can be null to start from a random vector.
+// Returns false if the computation failed.
+bool fiedler_vector_lanczos(
+	const WeightedGraph& graph,
+	const uint32_t max_iterations,
+	const float error,
+	const Eigen::VectorXf* initial_guess,
+	Eigen::VectorXf* fiedler,
+	SolveStats* stats);
+
+// Preconditioned gradient descent on the Rayleigh quotient, keeping the vector
+// orthogonal to the constant one. x is the initial vector and the result.
+// Returns the Rayleigh quotient.
+float smooth_fiedler_vector(
+	const WeightedGraph& graph,
+	const uint32_t steps,
+	Eigen::VectorXf* x,
+	SolveStats* stats);
+
+// Approximate Fiedler vector with a multilevel scheme: the graph is coarsened
+// with heavy-edge matching until it has at most coarsest_size vertices, solved
+// with Lanczos, and the solution is projected back and smoothed on each level.
+// Returns false if the coarse computation failed.
+bool fiedler_vector_multilevel(
+	const WeightedGraph& graph,
+	const uint32_t max_iterations,
+	const float error,
+	const uint32_t coarsest_size,
+	const uint32_t smoothing_steps,
+	Eigen::VectorXf* fiedler,
+	SolveStats* stats);
+
+} // namespace
@@ -1,10 +1,18 @@
 #undef NDEBUG
 #include "TriangleMesh.hpp"
+#include "Profiler.hpp"
+#include "PlyWriter.hpp"
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <tuple>
 
 TriangleMesh::TriangleMesh(const char* path)
 {
+	Profiler::ScopedTimer timer("mesh/read_ply");
 	parse_ply(path);
 }
 
@@ -13,31 +21,19 @@ void TriangleMesh::print_debug_info() const
 	std::cout << "Mesh with:\n"
 		"\tNum Vertices: " << m_vertices.size() << "\n"
 		"\tNum Faces     " << m_faces.size() << std::endl;
+	if (!m_vertex_attributes.properties.empty()) {
+		std::cout << "\tVertex attributes:";
+		for (const PlyReader::Property& property : m_vertex_attributes.properties) {
+			std::cout << " " << property.name;
+		}
+		std::cout << std::endl;
+	}
 }
 
 void TriangleMesh::write_mesh_ply(const char* fileName, const std::vector<Eigen::Array3<uint8_t>>& colors) const
 {
-	std::ofstream stream(fileName, std::ios::binary | std::ios::trunc);
-
-	tinyply::PlyFile file;
-
-	file.add_properties_to_element("vertex", { "x", "y", "z" },
-		tinyply::Type::FLOAT32, m_vertices.size(),
-		reinterpret_cast<const uint8_t*>(m_vertices.data()),
-		tinyply::Type::INVALID, 0);
-
-	if (!colors.empty()) {
-		file.add_properties_to_element("vertex", { "red", "green", "blue" },
-			tinyply::Type::UINT8, colors.size(),
-			reinterpret_cast<const uint8_t*>(colors.data()),
-			tinyply::Type::INVALID, 0);
-	}
-	file.add_properties_to_element("face", { "vertex_indices" },
-		tinyply::Type::INT32, m_faces.size(),
-		reinterpret_cast<const uint8_t*>(m_faces.data()),
-		tinyply::Type::UINT8, 3);
-
-	file.write(stream, true);
+	Profiler::ScopedTimer timer("mesh/write_ply");
+	PlyWriter::write_mesh(fileName, m_vertices, m_vertex_attributes, colors, m_faces);
 }
 
 void TriangleMesh::write_mesh_vertices_sequence_ply(const char* fileName) const
@@ -73,42 +69,183 @@ void TriangleMesh::write_mesh_vertices_sequence_ply(const char* fileName) const
 }
 
 
+void TriangleMesh::get_bounding_box(Eigen::Vector3f* min, Eigen::Vector3f* max) const
+{
+	*min = Eigen::Vector3f::Constant( std::numeric_limits<float>::infinity());
+	*max = Eigen::Vector3f::Constant(-std::numeric_limits<float>::infinity());
+
+	for (const Eigen::Vector3f& v : m_vertices) {
+		*min = min->cwiseMin(v);
+		*max = max->cwiseMax(v);
+	}
+}
+
 void TriangleMesh::rearrange_vertices(const std::vector<uint32_t>& old2new)
 {
+	Profiler::ScopedTimer timer("mesh/rearrange_vertices");
 	assert(old2new.size() == m_vertices.size());
-	std::vector<Eigen::Vector3f> new_vertices(m_vertices.size());
-	for (uint32_t i = 0; i < (uint32_t)m_vertices.size(); ++i) {
-		new_vertices[old2new[i]] = m_vertices[i];
+	const int64_t n = (int64_t)m_vertices.size();
+
+	// Each vertex moves with its attributes in the same pass
+	const size_t stride = m_vertex_attributes.stride;
+	const uint8_t* const attributes = m_vertex_attributes.data.data();
+	m_vertices_scratch.resize(n);
+	m_attributes_scratch.resize(m_vertex_attributes.data.size());
+	uint8_t* const new_attributes = m_attributes_scratch.data();
+#pragma omp parallel for schedule(static)
+	for (int64_t i = 0; i < n; ++i) {
+		m_vertices_scratch[old2new[i]] = m_vertices[i];
+		if (stride > 0) {
+			std::memcpy(new_attributes + (size_t)old2new[i] * stride, attributes + i * stride, stride);
+		}
 	}
-	m_vertices = new_vertices;
+	m_vertices.swap(m_vertices_scratch);
+	m_vertex_attributes.data.swap(m_attributes_scratch);
 
-	for (Eigen::Array3i& face : m_faces) {
+	const int64_t num_faces = (int64_t)m_faces.size();
+#pragma omp parallel for schedule(static)
+	for (int64_t f = 0; f < num_faces; ++f) {
 		for (uint32_t i = 0; i < 3; ++i) {
-			face[i] = old2new[face[i]];
+			m_faces[f][i] = old2new[m_faces[f][i]];
+		}
+	}
+
+	std::vector<uint32_t>& total = m_permutation.vertex_old2new;
+	if (total.empty()) {
+		total = old2new;
+	}
+	else {
+#pragma omp parallel for schedule(static)
+		for (int64_t i = 0; i < n; ++i) {
+			total[i] = old2new[total[i]];
 		}
 	}
 }
 
 void TriangleMesh::sort_faces()
 {
+	Profiler::ScopedTimer timer("mesh/sort_faces");
 	// Put the min vertex at the beginning
-	for (Eigen::Array3i& face : m_faces) {
-		int32_t m = face.minCoeff();
-		while (m != face[0]) {
-			std::rotate(face.begin(), face.begin() + 1, face.end());
+	std::vector<uint8_t> first_corner(m_faces.size());
+	for (size_t f = 0; f < m_faces.size(); ++f) {
+		const Eigen::Array3i& face = m_faces[f];
+		uint8_t corner = 0;
+		for (uint8_t i = 1; i < 3; ++i) {
+			if (face[i] < face[corner]) {
+				corner = i;
+			}
 		}
+		first_corner[f] = corner;
 	}
+	rotate_faces(first_corner);
+
+	// Sort the faces, equal ones by their position
+	std::vector<uint32_t> order(m_faces.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+		const Eigen::Array3i& fa = m_faces[a];
+		const Eigen::Array3i& fb = m_faces[b];
+		return std::tie(fa[0], fa[1], fa[2], a) < std::tie(fb[0], fb[1], fb[2], b);
+	});
+	rearrange_faces(order);
+}
 
-	// Sort the faces
-	struct SortFace {
-		bool operator() (const Eigen::Array3i& a, const Eigen::Array3i& b) { return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end()); }
-	} sort_face_obj;
+void TriangleMesh::rotate_faces(const std::vector<uint8_t>& first_corner)
+{
+	assert(first_corner.size() == m_faces.size());
+	std::vector<uint8_t>& total = m_permutation.face_rotation;
+	for (size_t f = 0; f < m_faces.size(); ++f) {
+		const uint8_t corner = first_corner[f];
+		if (corner == 0) {
+			continue;
+		}
+		Eigen::Array3i& face = m_faces[f];
+		std::rotate(face.begin(), face.begin() + corner, face.end());
+		if (total.empty()) {
+			total.resize(m_faces.size(), 0);
+		}
+		total[f] = (total[f] + corner) % 3;
+	}
+}
+
+void TriangleMesh::rearrange_faces(const std::vector<uint32_t>& order)
+{
+	Profiler::ScopedTimer timer("mesh/rearrange_faces");
+	assert(order.size() == m_faces.size());
+	std::vector<Eigen::Array3i> new_faces(m_faces.size());
+	for (uint32_t i = 0; i < (uint32_t)m_faces.size(); ++i) {
+		new_faces[i] = m_faces[order[i]];
+	}
+	m_faces = std::move(new_faces);
 
-	std::sort(m_faces.begin(), m_faces.end(), sort_face_obj);
+	std::vector<uint32_t>& total = m_permutation.face_order;
+	if (total.empty()) {
+		total = order;
+	}
+	else {
+		std::vector<uint32_t> new_total(total.size());
+		for (uint32_t i = 0; i < (uint32_t)total.size(); ++i) {
+			new_total[i] = total[order[i]];
+		}
+		total = std::move(new_total);
+	}
+	std::vector<uint8_t>& rotation = m_permutation.face_rotation;
+	if (!rotation.empty()) {
+		std::vector<uint8_t> new_rotation(rotation.size());
+		for (uint32_t i = 0; i < (uint32_t)rotation.size(); ++i) {
+			new_rotation[i] = rotation[order[i]];
+		}
+		rotation = std::move(new_rotation);
+	}
+}
+
+void TriangleMesh::apply_permutation(const MeshPermutation& permutation)
+{
+	if ((!permutation.vertex_old2new.empty() && permutation.vertex_old2new.size() != m_vertices.size()) ||
+		(!permutation.face_order.empty() && permutation.face_order.size() != m_faces.size()) ||
+		(!permutation.face_rotation.empty() && permutation.face_rotation.size() != m_faces.size())) {
+		throw std::runtime_error("Error: The permutation does not match the mesh.");
+	}
+
+	if (!permutation.vertex_old2new.empty()) {
+		rearrange_vertices(permutation.vertex_old2new);
+	}
+	// The rotations refer to the faces at their final positions
+	if (!permutation.face_rotation.empty()) {
+		std::vector<uint8_t> first_corner(m_faces.size());
+		for (size_t i = 0; i < m_faces.size(); ++i) {
+			const size_t f = permutation.face_order.empty() ? i : permutation.face_order[i];
+			first_corner[f] = permutation.face_rotation[i];
+		}
+		rotate_faces(first_corner);
+	}
+	if (!permutation.face_order.empty()) {
+		rearrange_faces(permutation.face_order);
+	}
+}
+
+static PlyReader::Type ply_type(tinyply::Type type)
+{
+	switch (type) {
+	case tinyply::Type::INT8: return PlyReader::Type::Int8;
+	case tinyply::Type::UINT8: return PlyReader::Type::Uint8;
+	case tinyply::Type::INT16: return PlyReader::Type::Int16;
+	case tinyply::Type::UINT16: return PlyReader::Type::Uint16;
+	case tinyply::Type::INT32: return PlyReader::Type::Int32;
+	case tinyply::Type::UINT32: return PlyReader::Type::Uint32;
+	case tinyply::Type::FLOAT32: return PlyReader::Type::Float32;
+	case tinyply::Type::FLOAT64: return PlyReader::Type::Float64;
+	default: return PlyReader::Type::Invalid;
+	}
 }
 
 void TriangleMesh::parse_ply(const char* fileName)
 {
+	if (PlyReader::read_mesh(fileName, &m_vertices, &m_vertex_attributes, &m_faces)) {
+		return;
+	}
+
+	// Generic reader for the layouts that the fast one does not handle
 	std::ifstream stream(fileName, std::ios::binary);
 
 	if (!stream) {
@@ -121,19 +258,29 @@ void TriangleMesh::parse_ply(const char* fileName)
 		throw std::runtime_error("Error: Can't parse ply header.");
 	}
 
-	bool recomputeNormals = false;
-
-	std::shared_ptr<tinyply::PlyData> vertices, normals, texcoords, faces;
+	std::shared_ptr<tinyply::PlyData> vertices, faces;
 	try { vertices = file.request_properties_from_element("vertex", { "x", "y", "z" }); }
 	catch (const std::exception&) {}
 
-	try { normals = file.request_properties_from_element("vertex", { "nx", "ny", "nz" }); }
-	catch (const std::exception&) { recomputeNormals = true; }
-
-	try { texcoords = file.request_properties_from_element("vertex", { "u", "v" }); }
-	catch (const std::exception&) {}
-	try { texcoords = file.request_properties_from_element("vertex", { "s", "t" }); }
-	catch (const std::exception&) {}
+	// Every other vertex property, one by one
+	std::vector<PlyReader::Property> vertex_properties;
+	for (const tinyply::PlyElement& element : file.get_elements()) {
+		if (element.name == "vertex") {
+			for (const tinyply::PlyProperty& property : element.properties) {
+				PlyReader::Property p;
+				p.name = property.name;
+				p.type = ply_type(property.propertyType);
+				p.list_type = property.isList ? ply_type(property.listType) : PlyReader::Type::Invalid;
+				vertex_properties.push_back(p);
+			}
+			break;
+		}
+	}
+	m_vertex_attributes = PlyReader::attributes_layout(vertex_properties);
+	std::vector<std::shared_ptr<tinyply::PlyData>> attributes;
+	for (const PlyReader::Property& property : m_vertex_attributes.properties) {
+		attributes.push_back(file.request_properties_from_element("vertex", { property.name }));
+	}
 
 	try { faces = file.request_properties_from_element("face", { "vertex_indices" }, 3); }
 	catch (const std::exception&) {}
@@ -145,29 +292,42 @@ void TriangleMesh::parse_ply(const char* fileName)
 	}
 
 	assert(vertices->t == tinyply::Type::FLOAT32);
-	assert(!normals || normals->t == tinyply::Type::FLOAT32);
-	assert(!texcoords || texcoords->t == tinyply::Type::FLOAT32);
 
 	// copy vertices
 	m_vertices.resize(vertices->count);
 	for (size_t i = 0; i < vertices->count; ++i) {
 		std::memcpy(&m_vertices[i], vertices->buffer.get() + i * 3 * sizeof(float), 3 * sizeof(float));
-		//if (texcoords) {
-		//	std::memcpy(&(*outVertices)[i].texCoord, texcoords->buffer.get() + i * 2 * sizeof(float), 2 * sizeof(float));
-		//}
-		//if (normals) {
-		//	std::memcpy(&(*outVertices)[i].normal, normals->buffer.get() + i * 3 * sizeof(float), 3 * sizeof(float));
-		//}
+	}
+
+	// interleave the attributes
+	const size_t stride = m_vertex_attributes.stride;
+	m_vertex_attributes.data.resize(vertices->count * stride);
+	size_t offset = 0;
+	for (size_t k = 0; k < attributes.size(); ++k) {
+		const size_t size = PlyReader::type_size(m_vertex_attributes.properties[k].type);
+		for (size_t i = 0; i < vertices->count; ++i) {
+			std::memcpy(m_vertex_attributes.data.data() + i * stride + offset, attributes[k]->buffer.get() + i * size, size);
+		}
+		offset += size;
 	}
 
 	m_faces.resize(faces->count);
 	if (faces->t == tinyply::Type::UINT32 || faces->t == tinyply::Type::INT32) {
 		std::memcpy(m_faces.data(), faces->buffer.get(), faces->buffer.size_bytes());
 	}
-	else if (faces->t == tinyply::Type::UINT16 || faces->t == tinyply::Type::INT16) {
+	else if (faces->t == tinyply::Type::UINT16) {
+		for (size_t i = 0; i < faces->count; ++i) {
+			uint16_t tmp[3];
+			std::memcpy(tmp, faces->buffer.get() + i * 3 * sizeof(uint16_t), 3 * sizeof(uint16_t));
+			m_faces[i].x() = static_cast<int32_t>(tmp[0]);
+			m_faces[i].y() = static_cast<int32_t>(tmp[1]);
+			m_faces[i].z() = static_cast<int32_t>(tmp[2]);
+		}
+	}
+	else if (faces->t == tinyply::Type::INT16) {
 		for (size_t i = 0; i < faces->count; ++i) {
 			int16_t tmp[3];
-			std::memcpy(tmp, faces->buffer.get() + i * 3 * sizeof(int16_t), 3 * sizeof(uint16_t));
+			std::memcpy(tmp, faces->buffer.get() + i * 3 * sizeof(int16_t), 3 * sizeof(int16_t));
 			m_faces[i].x() = static_cast<int32_t>(tmp[0]);
 			m_faces[i].y() = static_cast<int32_t>(tmp[1]);
 			m_faces[i].z() = static_cast<int32_t>(tmp[2]);
@@ -176,4 +336,18 @@ void TriangleMesh::parse_ply(const char* fileName)
 	else {
 		throw std::runtime_error("Error: Cant read face format");
 	}
+
+	// Checked once here like in PlyReader, the graphs index by them without checks
+	const int64_t num_vertices = (int64_t)m_vertices.size();
+	const int64_t num_faces = (int64_t)m_faces.size();
+	int64_t out_of_range = 0;
+#pragma omp parallel for schedule(static) reduction(+:out_of_range)
+	for (int64_t f = 0; f < num_faces; ++f) {
+		for (uint32_t k = 0; k < 3; ++k) {
+			out_of_range += (m_faces[f][k] < 0 || m_faces[f][k] >= num_vertices);
+		}
+	}
+	if (out_of_range > 0) {
+		throw std::runtime_error("Error: Face index out of range in ply.");
+	}
 }
\ No newline at end of file
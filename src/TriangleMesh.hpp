@@ -4,7 +4,17 @@
 #include <tinyply.h>
 #include <vector>
 #include <cstdint>
-
+#include "PlyReader.hpp"
+
+// Reordering of the vertices and faces of a mesh, relative to the file it was read from.
+// Empty vectors mean that nothing moved.
+struct MeshPermutation {
+	std::vector<uint32_t> vertex_old2new;
+	// face_order[i] is the index in the file of the face at position i
+	std::vector<uint32_t> face_order;
+	// face_rotation[i] is the corner of that face in the file that comes first now
+	std::vector<uint8_t> face_rotation;
+};
 
 class TriangleMesh {
 public:
@@ -24,17 +34,44 @@ class TriangleMesh {
 		return m_faces;
 	}
 
+	const PlyReader::VertexAttributes& get_vertex_attributes() const {
+		return m_vertex_attributes;
+	}
+
+	// Every reordering done since the mesh was read
+	const MeshPermutation& get_permutation() const {
+		return m_permutation;
+	}
+
+	void get_bounding_box(Eigen::Vector3f* min, Eigen::Vector3f* max) const;
+
 	void rearrange_vertices(const std::vector<uint32_t>& old2new);
 
 	void sort_faces();
 
+	// order[i] is the old index of the face at position i
+	void rearrange_faces(const std::vector<uint32_t>& order);
+
+	// Reorders the mesh as the one with the same connectivity that produced the permutation.
+	// Throws if the sizes do not match.
+	void apply_permutation(const MeshPermutation& permutation);
+
 private:
 
 	void parse_ply(const char* path);
 
+	// Rotates each face so that its corner first_corner[f] comes first
+	void rotate_faces(const std::vector<uint8_t>& first_corner);
+
 	// Variables
 	std::vector<Eigen::Vector3f> m_vertices;
+	PlyReader::VertexAttributes m_vertex_attributes;
 	std::vector<Eigen::Array3i> m_faces;
+	MeshPermutation m_permutation;
+
+	// Targets of rearrange_vertices, reused between calls
+	std::vector<Eigen::Vector3f> m_vertices_scratch;
+	std::vector<uint8_t> m_attributes_scratch;
 
 
 };
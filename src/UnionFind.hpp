@@ -1,101 +1,87 @@
 #pragma once
 
 #include <vector>
-#include <unordered_map>
-#include <numeric>
+#include <atomic>
+#include <cstdint>
 
-template <typename T>
+// Disjoint sets over the dense indices [0, n).
+// union_sets and find can be called concurrently. Roots are linked with an
+// atomic compare and swap, always the larger index below the smaller one,
+// so the root of each set is its smallest index whatever the scheduling.
 class UnionFind
 {
 public:
-	UnionFind(const std::vector<T>& ids) {
-		m_id_to_obj = ids;
-		m_num_sets = (uint32_t)ids.size();
-		m_set_sizes.resize(ids.size(), 1);
-		m_element_set.resize(ids.size());
-		std::iota(m_element_set.begin(), m_element_set.end(), 0);
-
-		for (uint32_t i = 0; i < m_num_sets; ++i) {
-			m_obj_to_id.insert({ ids[i], i });
+	UnionFind(uint32_t n) : m_parent(n) {
+		for (uint32_t i = 0; i < n; ++i) {
+			m_parent[i].store(i, std::memory_order_relaxed);
 		}
 	}
 
-	void union_sets(const T& x_, const T& y_) {
-		const auto f_x = m_obj_to_id.find(x_);
-		if (f_x == m_obj_to_id.end()) {
-			return;
-		}
-		const auto f_y = m_obj_to_id.find(y_);
-		if (f_y == m_obj_to_id.end()) {
-			return;
+	uint32_t size() const { return (uint32_t)m_parent.size(); }
+
+	uint32_t find(uint32_t x) {
+		for (;;) {
+			uint32_t p = m_parent[x].load(std::memory_order_relaxed);
+			if (p == x) {
+				return x;
+			}
+			const uint32_t gp = m_parent[p].load(std::memory_order_relaxed);
+			// Path halving. If it fails another thread already changed it.
+			if (p != gp) {
+				m_parent[x].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+			}
+			x = gp;
 		}
-		uint32_t x = this->find_id(f_x->second);
-		uint32_t y = this->find_id(f_y->second);
+	}
 
-		// merge if in different sets
-		if (x != y) {
-			// balance tree
-			if (m_set_sizes[x] > m_set_sizes[y]) {
+	void union_sets(uint32_t x, uint32_t y) {
+		for (;;) {
+			x = find(x);
+			y = find(y);
+			if (x == y) {
+				return;
+			}
+			if (x < y) {
 				std::swap(x, y);
 			}
-
-			m_element_set[x] = m_element_set[y];
-			m_set_sizes[y] += m_set_sizes[x];
-
-			m_num_sets -= 1;
+			uint32_t expected = x;
+			if (m_parent[x].compare_exchange_strong(expected, y, std::memory_order_relaxed)) {
+				return;
+			}
 		}
 	}
 
-	uint32_t get_num_sets() const { return m_num_sets; }
-
-	void get_elements_of_sets(std::vector<std::vector<T>>* out) {
-
-		assert(out->size() >= get_num_sets());
-
-		std::map<uint32_t, uint32_t> id_2_set;
-		for (uint32_t i = 0; i < (uint32_t)m_element_set.size(); ++i) {
-			uint32_t id = find_id(i);
-			if (id_2_set.count(id) == 0) {
-				id_2_set.insert({ id, (uint32_t)id_2_set.size() });
+	// Elements of set s are elements[offsets[s] .. offsets[s + 1]), increasing.
+	// Sets are ordered by their smallest element.
+	// Must not run concurrently with union_sets.
+	void get_sets(std::vector<uint32_t>* offsets, std::vector<uint32_t>* elements) {
+		const uint32_t n = size();
+		std::vector<uint32_t> set_of(n);
+
+		// The root is the smallest element, so it is labeled before the rest
+		offsets->assign(1, 0);
+		for (uint32_t i = 0; i < n; ++i) {
+			const uint32_t root = find(i);
+			if (root == i) {
+				set_of[i] = (uint32_t)offsets->size() - 1;
+				offsets->push_back(0);
+			}
+			else {
+				set_of[i] = set_of[root];
 			}
+			(*offsets)[set_of[i] + 1] += 1;
 		}
-
-		for (std::vector<T>& s : (*out)) {
-			s.clear();
+		for (size_t s = 1; s < offsets->size(); ++s) {
+			(*offsets)[s] += (*offsets)[s - 1];
 		}
 
-		// It should be compressed after this for sure
-		for (uint32_t i = 0; i < (uint32_t)m_element_set.size(); ++i) {
-			(*out)[id_2_set.at(m_element_set[find_id(i)])].push_back(m_id_to_obj[i]);
+		elements->resize(n);
+		std::vector<uint32_t> cursor(offsets->begin(), offsets->end() - 1);
+		for (uint32_t i = 0; i < n; ++i) {
+			(*elements)[cursor[set_of[i]]++] = i;
 		}
 	}
 
-
 private:
-
-	std::vector<uint32_t> m_element_set;
-	std::vector<uint32_t> m_set_sizes;
-	std::unordered_map<T, uint32_t> m_obj_to_id;
-	std::vector<T> m_id_to_obj;
-
-	uint32_t m_num_sets;
-
-	uint32_t find_id(uint32_t x) {
-		uint32_t h = x;
-
-		while (h != m_element_set[h]) {
-			h = m_element_set[h];
-		}
-
-		// compress
-		while (x != h) {
-			uint32_t next = m_element_set[x];
-			m_element_set[x] = h;
-			x = next;
-		}
-
-		return h;
-	}
-
+	std::vector<std::atomic<uint32_t>> m_parent;
 };
-
@@ -0,0 +1,215 @@
+#include "VertexCacheOptimizer.hpp"
+
+#include <algorithm>
+#include <limits>
+#include "Profiler.hpp"
+
+namespace VertexCacheOptimizer {
+
+static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+std::vector<uint32_t> cluster_face_groups(const TriangleMesh& mesh, const std::vector<uint32_t>& vertex_clusters)
+{
+	assert(vertex_clusters.size() == mesh.get_vertices().size());
+
+	std::vector<uint32_t> rank;
+	uint32_t next_rank = 0;
+	for (uint32_t c : vertex_clusters) {
+		if (c >= (uint32_t)rank.size()) {
+			rank.resize(c + 1, NONE);
+		}
+		if (rank[c] == NONE) {
+			rank[c] = next_rank++;
+		}
+	}
+
+	const std::vector<Eigen::Array3i>& faces = mesh.get_faces();
+	std::vector<uint32_t> groups(faces.size());
+	for (uint32_t f = 0; f < (uint32_t)faces.size(); ++f) {
+		groups[f] = rank[vertex_clusters[faces[f].minCoeff()]];
+	}
+	return groups;
+}
+
+// Buffers reused between the groups of a thread
+struct TipsifyBuffers {
+	std::vector<uint32_t> vertices;
+	std::vector<uint32_t> tri_vertices;
+	std::vector<uint32_t> adj_offsets;
+	std::vector<uint32_t> adj_tris;
+	std::vector<uint32_t> live;
+	std::vector<int64_t> cache_time;
+	std::vector<uint8_t> emitted;
+	std::vector<uint32_t> dead_end;
+	std::vector<uint32_t> candidates;
+};
+
+// Tipsify over the faces of one group, with local vertex indices
+static void tipsify_group(
+	const std::vector<Eigen::Array3i>& faces,
+	const uint32_t* group_faces,
+	const uint32_t num_faces,
+	const uint32_t cache_size,
+	TipsifyBuffers* b,
+	uint32_t* out)
+{
+	// Local vertices
+	b->vertices.clear();
+	for (uint32_t t = 0; t < num_faces; ++t) {
+		for (uint32_t j = 0; j < 3; ++j) {
+			b->vertices.push_back(faces[group_faces[t]][j]);
+		}
+	}
+	std::sort(b->vertices.begin(), b->vertices.end());
+	b->vertices.erase(std::unique(b->vertices.begin(), b->vertices.end()), b->vertices.end());
+	const uint32_t num_vertices = (uint32_t)b->vertices.size();
+
+	b->tri_vertices.resize(3 * num_faces);
+	b->live.assign(num_vertices, 0);
+	for (uint32_t t = 0; t < num_faces; ++t) {
+		for (uint32_t j = 0; j < 3; ++j) {
+			const uint32_t v = (uint32_t)(std::lower_bound(b->vertices.begin(), b->vertices.end(),
+				(uint32_t)faces[group_faces[t]][j]) - b->vertices.begin());
+			b->tri_vertices[3 * t + j] = v;
+			b->live[v] += 1;
+		}
+	}
+
+	// Vertex to triangles
+	b->adj_offsets.assign(num_vertices + 1, 0);
+	for (uint32_t v = 0; v < num_vertices; ++v) {
+		b->adj_offsets[v + 1] = b->adj_offsets[v] + b->live[v];
+	}
+	b->adj_tris.resize(3 * num_faces);
+	b->candidates.assign(b->adj_offsets.begin(), b->adj_offsets.end() - 1);
+	for (uint32_t t = 0; t < num_faces; ++t) {
+		for (uint32_t j = 0; j < 3; ++j) {
+			b->adj_tris[b->candidates[b->tri_vertices[3 * t + j]]++] = t;
+		}
+	}
+
+	b->cache_time.assign(num_vertices, 0);
+	b->emitted.assign(num_faces, 0);
+	b->dead_end.clear();
+
+	int64_t time = cache_size + 1;
+	uint32_t cursor = 0;
+	uint32_t num_out = 0;
+	uint32_t f = num_vertices > 0 ? 0 : NONE;
+
+	while (f != NONE) {
+		b->candidates.clear();
+
+		// Emit all the remaining triangles of f
+		for (uint32_t k = b->adj_offsets[f]; k < b->adj_offsets[f + 1]; ++k) {
+			const uint32_t t = b->adj_tris[k];
+			if (b->emitted[t]) {
+				continue;
+			}
+			b->emitted[t] = 1;
+			out[num_out++] = group_faces[t];
+			for (uint32_t j = 0; j < 3; ++j) {
+				const uint32_t v = b->tri_vertices[3 * t + j];
+				b->dead_end.push_back(v);
+				b->candidates.push_back(v);
+				b->live[v] -= 1;
+				if (time - b->cache_time[v] > (int64_t)cache_size) {
+					b->cache_time[v] = time;
+					time += 1;
+				}
+			}
+		}
+
+		// Next fanning vertex: the oldest candidate still in the cache after its triangles
+		f = NONE;
+		int64_t best_priority = -1;
+		for (uint32_t v : b->candidates) {
+			if (b->live[v] == 0) {
+				continue;
+			}
+			int64_t priority = 0;
+			if (time - b->cache_time[v] + 2 * (int64_t)b->live[v] <= (int64_t)cache_size) {
+				priority = time - b->cache_time[v];
+			}
+			if (priority > best_priority) {
+				best_priority = priority;
+				f = v;
+			}
+		}
+
+		// Dead end: recently used vertices, then in input order
+		while (f == NONE && !b->dead_end.empty()) {
+			const uint32_t v = b->dead_end.back();
+			b->dead_end.pop_back();
+			if (b->live[v] > 0) {
+				f = v;
+			}
+		}
+		while (f == NONE && cursor < num_vertices) {
+			if (b->live[cursor] > 0) {
+				f = cursor;
+			}
+			cursor += 1;
+		}
+	}
+
+	assert(num_out == num_faces);
+}
+
+std::vector<uint32_t> tipsify_face_order(const TriangleMesh& mesh, const std::vector<uint32_t>& face_groups, const uint32_t cache_size)
+{
+	Profiler::ScopedTimer timer("tipsify/face_order");
+	const std::vector<Eigen::Array3i>& faces = mesh.get_faces();
+	assert(face_groups.size() == faces.size());
+
+	// Faces of each group, keeping their order
+	const uint32_t num_groups = faces.empty() ? 0 : 1 + *std::max_element(face_groups.begin(), face_groups.end());
+	std::vector<uint32_t> group_offsets(num_groups + 1, 0);
+	for (uint32_t g : face_groups) {
+		group_offsets[g + 1] += 1;
+	}
+	for (uint32_t g = 0; g < num_groups; ++g) {
+		group_offsets[g + 1] += group_offsets[g];
+	}
+	std::vector<uint32_t> grouped(faces.size());
+	{
+		std::vector<uint32_t> cursor(group_offsets.begin(), group_offsets.end() - 1);
+		for (uint32_t f = 0; f < (uint32_t)faces.size(); ++f) {
+			grouped[cursor[face_groups[f]]++] = f;
+		}
+	}
+
+	std::vector<uint32_t> order(faces.size());
+	TipsifyBuffers buffers;
+
+#pragma omp parallel for schedule(dynamic) firstprivate(buffers)
+	for (int32_t g = 0; g < (int32_t)num_groups; ++g) {
+		tipsify_group(faces, grouped.data() + group_offsets[g],
+			group_offsets[g + 1] - group_offsets[g], cache_size,
+			&buffers, order.data() + group_offsets[g]);
+	}
+
+	return order;
+}
+
+std::vector<uint32_t> vertex_fetch_order(const TriangleMesh& mesh)
+{
+	Profiler::ScopedTimer timer("tipsify/vertex_fetch_order");
+	std::vector<uint32_t> old2new(mesh.get_vertices().size(), NONE);
+	uint32_t next = 0;
+	for (const Eigen::Array3i& face : mesh.get_faces()) {
+		for (uint32_t j = 0; j < 3; ++j) {
+			if (old2new[face[j]] == NONE) {
+				old2new[face[j]] = next++;
+			}
+		}
+	}
+	for (uint32_t& pos : old2new) {
+		if (pos == NONE) {
+			pos = next++;
+		}
+	}
+	return old2new;
+}
+
+} // namespace
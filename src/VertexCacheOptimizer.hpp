@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "TriangleMesh.hpp"
+
+namespace VertexCacheOptimizer {
+
+// Group of each face: rank of the cluster of its smallest vertex, with the
+// clusters ranked by their first vertex. vertex_clusters follows the current vertex order.
+std::vector<uint32_t> cluster_face_groups(const TriangleMesh& mesh, const std::vector<uint32_t>& vertex_clusters);
+
+// Face order for a post-transform vertex cache of cache_size entries, with the
+// Tipsify algorithm (Sander et al. 2007), in linear time.
+// Faces are emitted group by group, by increasing group.
+// Returns the old index of the face at each new position.
+std::vector<uint32_t> tipsify_face_order(const TriangleMesh& mesh, const std::vector<uint32_t>& face_groups, const uint32_t cache_size);
+
+// New position of each vertex by first use in the current face order.
+// Unreferenced vertices go to the end.
+std::vector<uint32_t> vertex_fetch_order(const TriangleMesh& mesh);
+
+} // namespace
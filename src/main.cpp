@@ -3,25 +3,66 @@
 #include <iostream>
 #include "Args.hpp"
 #include "TriangleMesh.hpp"
+#include "MeshGraph.hpp"
 #include "LayoutMaker.hpp"
 #include "LayoutOptimizer.hpp"
+#include "Benchmark.hpp"
+#include "LayoutMetrics.hpp"
+#include "CacheSimulator.hpp"
+#include "VertexCacheOptimizer.hpp"
+#include "SpaceFillingCurve.hpp"
+#include "CuthillMcKee.hpp"
+#include "Profiler.hpp"
+#include "PermutationFile.hpp"
+#include "ResultCache.hpp"
+#include "Batch.hpp"
 #include <chrono>
+#include <sstream>
+#include <thread>
 
 void print_usage() {
     std::cout << 
         "./mesh_layout_opt [options=?]\n"
-        "\t-in=input mesh path (.ply) [mandatory]\n"
+        "\t-in=input mesh path (.ply) [mandatory unless -batch]\n"
         "\t-mode=int [default=0]\n"
         "\t\t0: generate mesh with patches\n"
         "\t\t1: optimise mesh layout\n"
+        "\t\t2: optimise mesh layout and reorder faces for the vertex cache\n"
+        "\t\t3: sort vertices along a Morton curve\n"
+        "\t\t4: sort vertices along a Hilbert curve\n"
+        "\t\t5: sort vertices in reverse Cuthill-McKee order\n"
+        "\t\t6: apply the permutation file of -permutation, without computing a layout\n"
         "\t-out=output mesh path\n"
+        "\t-batch=directory of .ply meshes or file with a mesh path per line, reordered concurrently with modes 1 to 5\n"
+        "\t-out_dir=output directory of -batch [mandatory with -batch]\n"
+        "\t-batch_workers=int [default=hardware threads] meshes reordered at the same time by -batch\n"
         "\t-max_iterations=int [default=100000]\n"
         "\t-error=float [default=1.0e-7]\n"
+        "\t-adaptive_error loosens the error and max_iterations of the eigen solver on large partitions\n"
         "\t-max_deph=int [default=10]\n"
         "\t-max_cluster_size=int [default=100]\n"
         "\t-max_spectral_size=int [default=100000]\n"
+        "\t-warm_start seeds the eigen solver with the parent Fiedler vector\n"
+        "\t-multilevel uses a multilevel eigen solver for partitions larger than max_spectral_size, instead of an octree\n"
+        "\t-split=sign|median|ratio_cut|padded [default=sign] where partitions are split along the Fiedler vector\n"
+        "\t-parts=int [default=2] parts of each spectral split, from as many eigenvectors. -split applies to 2 parts\n"
+        "\t-max_exact_size=int [default=16] largest cluster ordered exactly, at most 18\n"
+        "\t-keep_cluster_order places the clusters by id instead of by adjacency\n"
         "\t-out_edges_model=output edges path ply\n"
+        "\t-permutation=path permutation file applied by mode 6\n"
+        "\t-out_permutation=path writes the vertex and face permutation of the output as a binary file\n"
+        "\t-compress_permutation stores the permutation as varints of the deltas between entries\n"
+        "\t-cache=directory reuses the layouts of meshes computed before with the same parameters\n"
+        "\t-cache_max_mb=int [default=1024] size of the cache directory, least recently used layouts are removed\n"
         "\t-c forces output model with colors of clusters\n"
+        "\t-metrics prints layout quality metrics of the input and output meshes\n"
+        "\t-simulate simulates the vertex and memory caches on the input and output meshes\n"
+        "\t-cache_size=int [default=32] entries of the vertex cache, for mode 2 and -simulate\n"
+        "\t-lru simulates a LRU vertex cache instead of FIFO\n"
+        "\t-eigen_solver=dense|lanczos|lobpcg [default=lanczos]\n"
+        "\t-bench_laplacian=int benchmarks int Laplacian products and exits\n"
+        "\t-bench_eigen=int benchmarks int splits with each eigen solver and exits\n"
+        "\t-report=path writes the time of each phase, counters and peak memory as JSON\n"
         "\t-h or --help to see this information\n"
         << std::endl;
 }
@@ -57,6 +98,8 @@ void assess_clustering_quality(const TriangleMesh &mesh, const std::vector<uint3
     }
     average_cluster_size /= (double_t)cluster_sizes.size();
 
+    Profiler::add_counter("clusters", cluster_sizes.size());
+
     std::cout << "Num clusters: " << cluster_sizes.size() <<
         "\nClusters quality:\n"
         "\tAverage size: " << average_cluster_size << "\n"
@@ -64,8 +107,109 @@ void assess_clustering_quality(const TriangleMesh &mesh, const std::vector<uint3
         "\tMax Size: " << max_cluster_size << std::endl;
 }
 
+// Move the colors with their vertices
+void rearrange_colors(const std::vector<uint32_t>& old2new, std::vector<Eigen::Array3<uint8_t>>* colors) {
+    if (colors->empty()) {
+        return;
+    }
+    std::vector<Eigen::Array3<uint8_t>> new_colors(colors->size());
+    for (uint32_t i = 0; i < (uint32_t)colors->size(); ++i) {
+        new_colors[old2new[i]] = (*colors)[i];
+    }
+    *colors = std::move(new_colors);
+}
+
+// Random color of the cluster of each vertex
+std::vector<Eigen::Array3<uint8_t>> cluster_colors(const std::vector<uint32_t>& clusters) {
+    // find max id
+    uint32_t num_colors = 0;
+    for (uint32_t i = 0; i < (uint32_t)clusters.size(); ++i) {
+        num_colors = std::max(num_colors, clusters[i]);
+    }
+
+    // Random colors
+    std::vector<Eigen::Array3<uint8_t>> color_map(num_colors + 1);
+    for (Eigen::Array3<uint8_t>& color : color_map) {
+        color.setRandom();
+    }
+
+    std::vector<Eigen::Array3<uint8_t>> colors(clusters.size());
+    for (uint32_t i = 0; i < (uint32_t)colors.size(); ++i) {
+        colors[i] = color_map[clusters[i]];
+    }
+    return colors;
+}
+
+// Stores the clusters and the reordering of the mesh in the cache directory
+void store_in_cache(const Args& args, const ResultCache::Key& key, uint64_t max_bytes,
+    const std::vector<uint32_t>& clusters, const TriangleMesh& mesh) {
+    Profiler::ScopedTimer timer("cache/store");
+    ResultCache::Entry entry;
+    entry.clusters = clusters;
+    entry.permutation = mesh.get_permutation();
+    if (!ResultCache::store(args.get("cache"), key, mesh, entry, max_bytes)) {
+        std::cerr << "Could not store the layout in the cache " << args.get("cache") << std::endl;
+    }
+}
+
+// Vertex order of the modes that sort the vertices without clusters
+std::vector<uint32_t> vertex_order(int32_t mode, const TriangleMesh& mesh) {
+    if (mode == 3) {
+        return SpaceFillingCurve::morton_order(mesh);
+    }
+    else if (mode == 4) {
+        return SpaceFillingCurve::hilbert_order(mesh);
+    }
+    const MeshGraph graph(mesh);
+    return CuthillMcKee::reverse_cuthill_mckee_order(graph);
+}
+
+// Emits the faces cluster by cluster for the vertex cache, after the vertices were moved to new_pos,
+// then the vertices in order of first use. Returns the last vertex reordering
+std::vector<uint32_t> reorder_for_vertex_cache(TriangleMesh* mesh, const std::vector<uint32_t>& clusters,
+    const std::vector<uint32_t>& new_pos, uint32_t vertex_cache_size) {
+    std::vector<uint32_t> new_clusters(clusters.size());
+    for (uint32_t i = 0; i < (uint32_t)clusters.size(); ++i) {
+        new_clusters[new_pos[i]] = clusters[i];
+    }
+    mesh->rearrange_faces(VertexCacheOptimizer::tipsify_face_order(*mesh,
+        VertexCacheOptimizer::cluster_face_groups(*mesh, new_clusters),
+        vertex_cache_size));
+
+    const std::vector<uint32_t> fetch_pos = VertexCacheOptimizer::vertex_fetch_order(*mesh);
+    mesh->rearrange_vertices(fetch_pos);
+    return fetch_pos;
+}
+
+// Writes the reordering of the mesh if requested
+void write_permutation(const Args& args, const TriangleMesh& mesh) {
+    if (args.has("out_permutation")) {
+        PermutationFile::write(args.get("out_permutation").c_str(), mesh.get_permutation(),
+            mesh.get_vertices().size(), mesh.get_faces().size(), args.has("compress_permutation"));
+    }
+}
+
+// Writes the JSON report if requested, after ending the total time
+bool write_report(const Args& args, Profiler::ScopedTimer* total_timer) {
+    total_timer->stop();
+    if (!args.has("report")) {
+        return true;
+    }
+    std::vector<std::string> arguments;
+    for (uint32_t i = 0; i < (uint32_t)args.numArgs(); ++i) {
+        arguments.push_back(args.get(i));
+    }
+    if (!Profiler::write_report(args.get("report").c_str(), arguments)) {
+        std::cerr << "Could not write the report " << args.get("report") << std::endl;
+        return false;
+    }
+    return true;
+}
+
 int main(int argc, char** argv) {
     Args args(argc, argv);
+    Profiler::set_enabled(args.has("report"));
+    Profiler::ScopedTimer total_timer("total");
 
     if (args.has("h") || args.has("-help")) {
         print_usage();
@@ -73,12 +217,12 @@ int main(int argc, char** argv) {
     }
 
     std::string in;
-    if (!args.has("in")) {
+    if (!args.has("in") && !args.has("batch")) {
         std::cerr << "Missing *in* parameter" << std::endl;
         print_usage();
         return 1;
     }
-    else {
+    else if (args.has("in")) {
         in = args.get("in");
     }
     std::string out;
@@ -107,10 +251,80 @@ int main(int argc, char** argv) {
         max_spectral_size = (uint32_t)std::stoi(args.get("max_spectral_size"));
     }
 
+    uint32_t max_exact_size = 16;
+    if (args.has("max_exact_size")) {
+        max_exact_size = (uint32_t)std::stoi(args.get("max_exact_size"));
+    }
+
     int32_t mode = 0;
     if (args.has("mode")) {
         mode = std::stoi(args.get("mode"));
-        if (mode < 0 || mode > 1) {
+        if (mode < 0 || mode > 6) {
+            print_usage();
+            return 1;
+        }
+    }
+    if (args.has("batch") && (mode < 1 || mode > 5)) {
+        std::cerr << "-batch reorders with modes 1 to 5" << std::endl;
+        print_usage();
+        return 1;
+    }
+    if (args.has("batch") && !args.has("out_dir")) {
+        std::cerr << "Missing *out_dir* parameter" << std::endl;
+        print_usage();
+        return 1;
+    }
+    if (mode == 6 && !args.has("permutation")) {
+        std::cerr << "Missing *permutation* parameter" << std::endl;
+        print_usage();
+        return 1;
+    }
+
+    LayoutMaker::SplitStrategy split = LayoutMaker::SplitStrategy::Sign;
+    if (args.has("split")) {
+        const std::string& name = args.get("split");
+        if (name == "sign") {
+            split = LayoutMaker::SplitStrategy::Sign;
+        }
+        else if (name == "median") {
+            split = LayoutMaker::SplitStrategy::Median;
+        }
+        else if (name == "ratio_cut") {
+            split = LayoutMaker::SplitStrategy::RatioCut;
+        }
+        else if (name == "padded") {
+            split = LayoutMaker::SplitStrategy::Padded;
+        }
+        else {
+            std::cerr << "Unknown split " << name << std::endl;
+            print_usage();
+            return 1;
+        }
+    }
+
+    uint32_t num_parts = 2;
+    if (args.has("parts")) {
+        num_parts = (uint32_t)std::stoi(args.get("parts"));
+        if (num_parts < 2) {
+            print_usage();
+            return 1;
+        }
+    }
+
+    LayoutMaker::EigenSolver eigen_solver = LayoutMaker::EigenSolver::Lanczos;
+    if (args.has("eigen_solver")) {
+        const std::string& name = args.get("eigen_solver");
+        if (name == "dense") {
+            eigen_solver = LayoutMaker::EigenSolver::Dense;
+        }
+        else if (name == "lanczos") {
+            eigen_solver = LayoutMaker::EigenSolver::Lanczos;
+        }
+        else if (name == "lobpcg") {
+            eigen_solver = LayoutMaker::EigenSolver::Lobpcg;
+        }
+        else {
+            std::cerr << "Unknown eigen solver " << name << std::endl;
             print_usage();
             return 1;
         }
@@ -120,25 +334,226 @@ int main(int argc, char** argv) {
     if (args.has("error")) {
         error = std::stof(args.get("error"));
     }
+
+    uint64_t cache_max_bytes = 1024ull << 20;
+    if (args.has("cache_max_mb")) {
+        cache_max_bytes = (uint64_t)std::stoll(args.get("cache_max_mb")) << 20;
+    }
     
+    CacheSimulator::Config cache_config;
+    if (args.has("cache_size")) {
+        cache_config.vertex_cache_size = (uint32_t)std::stoi(args.get("cache_size"));
+    }
+    cache_config.vertex_cache_lru = args.has("lru");
+
+    if (args.has("batch")) {
+        uint32_t num_workers = std::max(1u, std::thread::hardware_concurrency());
+        if (args.has("batch_workers")) {
+            num_workers = (uint32_t)std::max(1, std::stoi(args.get("batch_workers")));
+        }
+        std::vector<std::string> inputs;
+        try {
+            inputs = Batch::list_inputs(args.get("batch"));
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        std::cout << "Batch of " << inputs.size() << " meshes with " << num_workers << " workers" << std::endl;
+
+        const Batch::Process process = [&](const std::shared_ptr<TriangleMesh>& batch_mesh) {
+            if (mode >= 3) {
+                batch_mesh->rearrange_vertices(vertex_order(mode, *batch_mesh));
+                batch_mesh->sort_faces();
+                return;
+            }
+            const MeshGraph graph(*batch_mesh);
+            const std::vector<uint32_t> clusters = LayoutMaker::get_mapping_optimized_layout(
+                batch_mesh, graph,
+                max_depth, max_cluster_size, max_spectral_size,
+                max_number_interations_eigen, error,
+                args.has("warm_start"), args.has("multilevel"), split, num_parts, args.has("adaptive_error"), eigen_solver);
+            const std::vector<uint32_t> new_pos = LayoutOptimizer::optimize_layout(graph, clusters, max_exact_size, !args.has("keep_cluster_order"));
+            batch_mesh->rearrange_vertices(new_pos);
+            if (mode == 1) {
+                batch_mesh->sort_faces();
+            }
+            else {
+                reorder_for_vertex_cache(batch_mesh.get(), clusters, new_pos, cache_config.vertex_cache_size);
+            }
+        };
+
+        Batch::Report report;
+        try {
+            report = Batch::run(inputs, args.get("out_dir"), process, num_workers);
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        Batch::print(report);
+        const bool report_written = write_report(args, &total_timer);
+        return (report.num_failed == 0 && report_written) ? 0 : 1;
+    }
+
     std::shared_ptr<TriangleMesh> mesh = std::make_shared<TriangleMesh>(in.c_str());
 
     mesh->print_debug_info();
+    Profiler::add_counter("mesh/vertices", mesh->get_vertices().size());
+    Profiler::add_counter("mesh/faces", mesh->get_faces().size());
+
+    if (args.has("metrics")) {
+        LayoutMetrics::print(LayoutMetrics::compute(*mesh), "Input");
+    }
+
+    if (args.has("simulate")) {
+        CacheSimulator::print(CacheSimulator::simulate(*mesh, cache_config), cache_config, "Input");
+    }
+
+    if (args.has("bench_laplacian")) {
+        const MeshGraph graph(*mesh);
+        Benchmark::laplacian_products(graph, (uint32_t)std::stoi(args.get("bench_laplacian")));
+        return write_report(args, &total_timer) ? 0 : 1;
+    }
+
+    if (args.has("bench_eigen")) {
+        const MeshGraph graph(*mesh);
+        Benchmark::eigen_solvers(graph, max_number_interations_eigen, error, (uint32_t)std::stoi(args.get("bench_eigen")));
+        return write_report(args, &total_timer) ? 0 : 1;
+    }
+
+    // Mode 6 does not compute anything to cache
+    const bool use_cache = args.has("cache") && mode != 6;
+    ResultCache::Key cache_key;
+    if (use_cache) {
+        const auto ini_timer_h = std::chrono::high_resolution_clock::now();
+
+        // Everything that changes the layout, besides the mesh
+        std::ostringstream parameters;
+        parameters.precision(9);
+        parameters << "mode=" << mode << " max_depth=" << max_depth << " max_cluster_size=" << max_cluster_size <<
+            " max_spectral_size=" << max_spectral_size << " max_iterations=" << max_number_interations_eigen <<
+            " error=" << error << " max_exact_size=" << max_exact_size <<
+            " warm_start=" << args.has("warm_start") << " multilevel=" << args.has("multilevel") <<
+            " split=" << (int)split << " parts=" << num_parts << " adaptive_error=" << args.has("adaptive_error") <<
+            " eigen_solver=" << (int)eigen_solver << " keep_cluster_order=" << args.has("keep_cluster_order") <<
+            " cache_size=" << cache_config.vertex_cache_size;
+
+        ResultCache::Entry cached;
+        bool hit;
+        {
+            Profiler::ScopedTimer timer("cache/lookup");
+            cache_key = ResultCache::make_key(*mesh, parameters.str());
+            hit = ResultCache::load(args.get("cache"), cache_key, *mesh, &cached);
+        }
+        if (hit) {
+            std::cout << "Cache hit" << std::endl;
+            mesh->apply_permutation(cached.permutation);
+
+            std::vector<Eigen::Array3<uint8_t>> colors;
+            if (!cached.clusters.empty() && (mode == 0 || args.has("c"))) {
+                colors = cluster_colors(cached.clusters);
+                if (!cached.permutation.vertex_old2new.empty()) {
+                    rearrange_colors(cached.permutation.vertex_old2new, &colors);
+                }
+            }
+
+            const auto end_timer_h = std::chrono::high_resolution_clock::now();
+            const std::chrono::duration<double> duration_h = end_timer_h - ini_timer_h;
+            std::cout << "Cached layout took " << duration_h.count() << " s." << std::endl;
+
+            if (mode != 0) {
+                if (args.has("metrics")) {
+                    LayoutMetrics::print(LayoutMetrics::compute(*mesh), "Output");
+                }
+                if (args.has("simulate")) {
+                    CacheSimulator::print(CacheSimulator::simulate(*mesh, cache_config), cache_config, "Output");
+                }
+            }
+
+            mesh->write_mesh_ply(out.c_str(), colors);
+            if (mode != 0) {
+                write_permutation(args, *mesh);
+            }
+            if (args.has("out_edges_model")) {
+                mesh->write_mesh_vertices_sequence_ply(args.get("out_edges_model").c_str());
+            }
+            return write_report(args, &total_timer) ? 0 : 1;
+        }
+        std::cout << "Cache miss" << std::endl;
+    }
+
+    if (mode >= 3) {
+        const auto ini_timer_c = std::chrono::high_resolution_clock::now();
+
+        if (mode == 6) {
+            uint64_t num_vertices, num_faces;
+            const MeshPermutation permutation = PermutationFile::read(args.get("permutation").c_str(), &num_vertices, &num_faces);
+            if (num_vertices != mesh->get_vertices().size() || num_faces != mesh->get_faces().size()) {
+                std::cerr << "The permutation is for a mesh with " << num_vertices << " vertices and " <<
+                    num_faces << " faces" << std::endl;
+                return 1;
+            }
+            mesh->apply_permutation(permutation);
+        }
+        else {
+            mesh->rearrange_vertices(vertex_order(mode, *mesh));
+            mesh->sort_faces();
+        }
+
+        const auto end_timer_c = std::chrono::high_resolution_clock::now();
+        const std::chrono::duration<double> duration_c = end_timer_c - ini_timer_c;
+        const char* layout_names[] = { "Morton", "Hilbert", "Reverse Cuthill-McKee", "Stored" };
+        std::cout << layout_names[mode - 3] << " layout took " << duration_c.count() << " s." << std::endl;
+
+        if (args.has("metrics")) {
+            LayoutMetrics::print(LayoutMetrics::compute(*mesh), "Output");
+        }
+        if (args.has("simulate")) {
+            CacheSimulator::print(CacheSimulator::simulate(*mesh, cache_config), cache_config, "Output");
+        }
+
+        mesh->write_mesh_ply(out.c_str());
+        write_permutation(args, *mesh);
+        if (use_cache) {
+            store_in_cache(args, cache_key, cache_max_bytes, {}, *mesh);
+        }
+        if (args.has("out_edges_model")) {
+            mesh->write_mesh_vertices_sequence_ply(args.get("out_edges_model").c_str());
+        }
+        return write_report(args, &total_timer) ? 0 : 1;
+    }
 
     std::cout << "Starting clustering:\n"
         "\tMax depth: " << max_depth << "\n"
         "\tMax Cluster size: " << max_cluster_size << "\n"
         "\tMax Spectral size: " << max_spectral_size << "\n"
         "\tMax iterations Eigen: " << max_number_interations_eigen << "\n"
-        "\tError: " << error << std::endl;
+        "\tError: " << error << "\n"
+        "\tWarm start: " << (args.has("warm_start") ? "yes" : "no") << "\n"
+        "\tMultilevel: " << (args.has("multilevel") ? "yes" : "no") << "\n"
+        "\tSplit: " << (args.has("split") ? args.get("split") : "sign") << "\n"
+        "\tParts: " << num_parts << "\n"
+        "\tAdaptive error: " << (args.has("adaptive_error") ? "yes" : "no") << "\n"
+        "\tEigen solver: " << (args.has("eigen_solver") ? args.get("eigen_solver") : "lanczos") << std::endl;
 
     auto ini_timer = std::chrono::high_resolution_clock::now();
 
+    const MeshGraph graph(*mesh);
+
+    LayoutMaker::ClusteringStats clustering_stats;
     std::vector<uint32_t> clusters =
     LayoutMaker::get_mapping_optimized_layout(
-        mesh,
+        mesh, graph,
         max_depth, max_cluster_size, max_spectral_size,
-        max_number_interations_eigen, error);
+        max_number_interations_eigen, error,
+        args.has("warm_start"), args.has("multilevel"), split, num_parts, args.has("adaptive_error"), eigen_solver,
+        &clustering_stats);
+
+    std::cout << "Eigen solves: " << clustering_stats.num_solves <<
+        "\n\tIterations (Lanczos restarts): " << clustering_stats.num_iterations <<
+        "\n\tMatrix-vector products: " << clustering_stats.num_products <<
+        "\n\tFallbacks to smoothed guess: " << clustering_stats.num_fallbacks << std::endl;
 
     auto end_timer = std::chrono::high_resolution_clock::now();
     const std::chrono::duration<double> duration = end_timer - ini_timer;
@@ -154,33 +569,18 @@ int main(int argc, char** argv) {
     std::vector<Eigen::Array3<uint8_t>> colors;
 
     if (mode == 0 || args.has("c")) {
-        // find max id
-        uint32_t num_colors = 0;
-        for (uint32_t i = 0; i < (uint32_t)clusters.size(); ++i) {
-            num_colors = std::max(num_colors, clusters[i]);
-        }
-
-        // Random colors
-        std::vector<Eigen::Array3<uint8_t>> color_map(num_colors + 1);
-        for (Eigen::Array3<uint8_t>& color : color_map) {
-            color.setRandom();
-        }
-
-        colors = std::vector<Eigen::Array3<uint8_t>>(clusters.size());
-        for (uint32_t i = 0; i < (uint32_t)colors.size(); ++i) {
-            colors[i] = color_map[clusters[i]];
-        }
+        colors = cluster_colors(clusters);
     }
 
     if (mode == 0) {
         mesh->write_mesh_ply(out.c_str(), colors);
     }
 
-    if (mode == 1) {
+    if (mode == 1 || mode == 2) {
 
         const auto ini_timer_l = std::chrono::high_resolution_clock::now();
         
-        const std::vector<uint32_t> new_pos = LayoutOptimizer::optimize_layout(*mesh, clusters);
+        const std::vector<uint32_t> new_pos = LayoutOptimizer::optimize_layout(graph, clusters, max_exact_size, !args.has("keep_cluster_order"));
 
         const auto end_timer_l = std::chrono::high_resolution_clock::now();
         const std::chrono::duration<double> duration_l = end_timer_l - ini_timer_l;
@@ -188,13 +588,40 @@ int main(int argc, char** argv) {
         std::cout << "Total took " << duration_l.count() + duration.count() << " s." << std::endl;
 
         mesh->rearrange_vertices(new_pos);
+        rearrange_colors(new_pos, &colors);
 
-        mesh->sort_faces();
+        if (mode == 1) {
+            mesh->sort_faces();
+        }
+        else {
+            const auto ini_timer_f = std::chrono::high_resolution_clock::now();
+
+            const std::vector<uint32_t> fetch_pos = reorder_for_vertex_cache(mesh.get(), clusters, new_pos, cache_config.vertex_cache_size);
+            rearrange_colors(fetch_pos, &colors);
+
+            const auto end_timer_f = std::chrono::high_resolution_clock::now();
+            const std::chrono::duration<double> duration_f = end_timer_f - ini_timer_f;
+            std::cout << "Face reordering took " << duration_f.count() << " s." << std::endl;
+        }
+
+        if (args.has("metrics")) {
+            LayoutMetrics::print(LayoutMetrics::compute(*mesh), "Output");
+        }
+        if (args.has("simulate")) {
+            CacheSimulator::print(CacheSimulator::simulate(*mesh, cache_config), cache_config, "Output");
+        }
 
         mesh->write_mesh_ply(out.c_str(), colors);
+        write_permutation(args, *mesh);
+    }
+
+    if (use_cache) {
+        store_in_cache(args, cache_key, cache_max_bytes, clusters, *mesh);
     }
 
     if (args.has("out_edges_model")) {
         mesh->write_mesh_vertices_sequence_ply(args.get("out_edges_model").c_str());
     }
+
+    return write_report(args, &total_timer) ? 0 : 1;
 }
\ No newline at end of file